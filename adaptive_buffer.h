@@ -0,0 +1,52 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+
+// Read buffer that grows while bulk output keeps filling it and shrinks back
+// once traffic turns interactive, so large dumps need few wakeups while
+// keystroke echo stays on a small, cache-resident buffer.
+class AdaptiveBuffer {
+public:
+    AdaptiveBuffer(size_t min_size, size_t max_size)
+        : min_size_(min_size), max_size_(std::max(min_size, max_size)) {
+        reallocate(min_size_);
+    }
+
+    char* data() { return data_.get(); }
+    size_t capacity() const { return capacity_; }
+    size_t peakCapacity() const { return peak_capacity_; }
+
+    // Records how many bytes one wakeup gathered and resizes accordingly
+    void record(size_t bytes) {
+        if (bytes >= capacity_) {
+            small_streak_ = 0;
+            if (capacity_ < max_size_) reallocate(std::min(capacity_ * 2, max_size_));
+        } else if (bytes < capacity_ / 4 && capacity_ > min_size_) {
+            // Require a run of small wakeups so a brief pause in a flood doesn't shrink it
+            if (++small_streak_ >= kShrinkAfter) {
+                small_streak_ = 0;
+                reallocate(std::max(capacity_ / 2, min_size_));
+            }
+        } else {
+            small_streak_ = 0;
+        }
+    }
+
+private:
+    static constexpr int kShrinkAfter = 8;
+
+    void reallocate(size_t size) {
+        data_.reset(new char[size]);
+        capacity_ = size;
+        peak_capacity_ = std::max(peak_capacity_, size);
+    }
+
+    size_t min_size_;
+    size_t max_size_;
+    std::unique_ptr<char[]> data_;
+    size_t capacity_ = 0;
+    size_t peak_capacity_ = 0;
+    int small_streak_ = 0;
+};
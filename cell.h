@@ -0,0 +1,94 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// One character cell. At 8 bytes a 200-column row spans 25 cache lines and
+// rows can be filled, shifted and copied as plain memory.
+struct Cell {
+    enum Flag : uint8_t {
+        kWrapped = 1u << 0, // Set on the last cell of a row that soft-wraps onto the next
+        kWidePad = 1u << 1, // Blank left at a row end by a wide character that wrapped
+    };
+
+    char32_t codepoint; // ' ' in blank cells, 0 in the right half of a wide character
+    uint16_t style;     // Index into the StyleTable
+    uint8_t width;      // 1, 2 for the left half of a wide character, 0 for its right half
+    uint8_t flags;
+};
+static_assert(sizeof(Cell) == 8, "cells are packed into 8 bytes");
+
+inline Cell blankCell(uint16_t style) {
+    return Cell{U' ', style, 1, 0};
+}
+
+// Fills count cells with one value as 64-bit stores, which compilers vectorize
+inline void fillCells(Cell* cells, size_t count, Cell value) {
+    uint64_t pattern;
+    std::memcpy(&pattern, &value, sizeof(pattern));
+    uint64_t* words = reinterpret_cast<uint64_t*>(cells);
+    std::fill(words, words + count, pattern);
+}
+
+// Lays out one logical line in rows of cols cells appended to out. A wide
+// character that would straddle a row end moves to the next row, every row
+// but the last gets kWrapped on its last cell, and the last row is padded
+// with blanks. kWidePad cells from an earlier layout are dropped. A line
+// whose last cell has kWrapped had wrapped onto an empty row, which it keeps
+// when it again ends at a row end. Cell index mark, which may lie past the
+// end, is reported as its row and column in the new layout, adding rows if
+// it needs them. Returns the number of rows.
+inline size_t rewrapLine(const Cell* cells, size_t count, size_t cols, std::vector<Cell>& out,
+                         size_t mark = SIZE_MAX, size_t* mark_row = nullptr, size_t* mark_col = nullptr) {
+    size_t first = out.size();
+    size_t col = 0;
+    auto breakRow = [&](uint8_t pad_flags) {
+        Cell pad = blankCell(0);
+        pad.flags = pad_flags;
+        out.insert(out.end(), cols - col, pad);
+        out.back().flags |= Cell::kWrapped;
+        col = 0;
+    };
+    // Reports the position of out[at]
+    auto report = [&](size_t at) {
+        if (mark_row) *mark_row = (at - first) / cols;
+        if (mark_col) *mark_col = (at - first) % cols;
+    };
+    for (size_t i = 0; i < count; ++i) {
+        if (cells[i].flags & Cell::kWidePad) {
+            if (i == mark) report(out.size());
+            continue;
+        }
+        if (cells[i].width == 0) {
+            if (i == mark && i > 0) report(out.size() - (cols < 2 ? 1 : 2)); // A right half: its left half
+            continue;
+        }
+        Cell cell = cells[i];
+        cell.flags = 0;
+        if (cell.width == 2 && cols < 2) cell = blankCell(cell.style);
+        if (col + cell.width > cols) breakRow(col < cols ? Cell::kWidePad : 0);
+        if (i == mark) report(out.size());
+        out.push_back(cell);
+        if (cell.width == 2) out.push_back(Cell{0, cell.style, 0, 0});
+        col += cell.width;
+    }
+    bool empty_row = false; // The last row was started for the wrap or the mark and has no cells
+    if (count > 0 && (cells[count - 1].flags & Cell::kWrapped) && col == cols) {
+        breakRow(0);
+        empty_row = true;
+    }
+    if (mark != SIZE_MAX && mark >= count) {
+        size_t c = col + (mark - count);
+        while (c >= cols) {
+            breakRow(0);
+            c -= cols;
+            empty_row = true;
+        }
+        report(out.size() - col + c);
+    }
+    if (col > 0 || out.size() == first || empty_row) out.insert(out.end(), cols - col, blankCell(0));
+    return (out.size() - first) / cols;
+}
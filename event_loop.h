@@ -0,0 +1,316 @@
+#pragma once
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+
+// Readiness bits reported to event handlers
+enum EventMask : uint32_t {
+    kReadable = 1u << 0,
+    kWritable = 1u << 1,
+    kHangup   = 1u << 2,
+};
+
+// Switches a descriptor to non-blocking mode, returning its previous flags
+inline int setNonBlocking(int fd) {
+    int flags = fcntl(fd, F_GETFL);
+    if (flags == -1 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) == -1) {
+        throw std::runtime_error("Failed to set O_NONBLOCK: " + std::string(std::strerror(errno)));
+    }
+    return flags;
+}
+
+// Abstract readiness-based event loop.
+//
+// Handlers return true once their descriptor is drained (read or write hit
+// EAGAIN). A handler that stops early because of a fairness budget returns
+// false and is re-dispatched on the next iteration without waiting, which is
+// what makes edge-triggered backends safe to use with bounded reads.
+class EventLoop {
+public:
+    using Handler = std::function<bool(uint32_t events)>;
+
+    virtual ~EventLoop() {
+        for (int fd : timers_) close(fd);
+    }
+
+    virtual void add(int fd, uint32_t events, Handler handler) = 0;
+    virtual void modify(int fd, uint32_t events) = 0;
+    virtual void remove(int fd) = 0;
+
+    // Waits up to timeout_ms (-1 blocks) and dispatches ready handlers
+    virtual void runOnce(int timeout_ms) = 0;
+
+    virtual const char* name() const = 0;
+
+    // Registers a periodic (or one-shot when interval_ms is 0) timer backed by timerfd
+    int addTimer(int initial_ms, int interval_ms, std::function<void()> callback) {
+        int fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        if (fd == -1) {
+            throw std::runtime_error("timerfd_create failed: " + std::string(std::strerror(errno)));
+        }
+        timers_.push_back(fd);
+        armTimer(fd, initial_ms, interval_ms);
+        add(fd, kReadable, [fd, callback](uint32_t) {
+            uint64_t expirations;
+            while (read(fd, &expirations, sizeof(expirations)) == sizeof(expirations)) {}
+            callback();
+            return true;
+        });
+        return fd;
+    }
+
+    // Re-arms (or with initial_ms == 0, disarms) a timer created by addTimer
+    void armTimer(int fd, int initial_ms, int interval_ms) {
+        struct itimerspec spec = {};
+        spec.it_value.tv_sec = initial_ms / 1000;
+        spec.it_value.tv_nsec = (initial_ms % 1000) * 1000000L;
+        spec.it_interval.tv_sec = interval_ms / 1000;
+        spec.it_interval.tv_nsec = (interval_ms % 1000) * 1000000L;
+        timerfd_settime(fd, 0, &spec, nullptr);
+    }
+
+    void removeTimer(int fd) {
+        remove(fd);
+        close(fd);
+        for (auto it = timers_.begin(); it != timers_.end(); ++it) {
+            if (*it == fd) {
+                timers_.erase(it);
+                break;
+            }
+        }
+    }
+
+    // Creates the named backend ("epoll" or "poll")
+    static std::unique_ptr<EventLoop> create(const std::string& backend);
+
+protected:
+    struct Watch {
+        int fd;
+        uint32_t events;
+        Handler handler;
+        bool removed = false;
+        bool pending = false; // Handler asked to be called again without waiting
+    };
+
+    Watch* findWatch(int fd) {
+        auto it = watches_.find(fd);
+        return it == watches_.end() ? nullptr : it->second.get();
+    }
+
+    Watch* insertWatch(int fd, uint32_t events, Handler handler) {
+        if (findWatch(fd)) {
+            throw std::runtime_error("Descriptor already registered: " + std::to_string(fd));
+        }
+        auto watch = std::make_unique<Watch>(Watch{fd, events, std::move(handler)});
+        Watch* raw = watch.get();
+        watches_[fd] = std::move(watch);
+        return raw;
+    }
+
+    // Unregisters a watch; destruction is deferred until the current dispatch ends
+    void eraseWatch(int fd) {
+        auto it = watches_.find(fd);
+        if (it == watches_.end()) return;
+        it->second->removed = true;
+        retired_.push_back(std::move(it->second));
+        watches_.erase(it);
+    }
+
+    // Invokes a handler and records whether it still has work queued
+    void dispatch(Watch* watch, uint32_t events) {
+        if (watch->removed) return;
+        bool drained = watch->handler(events);
+        if (!watch->removed && !drained && !watch->pending) {
+            watch->pending = true;
+            pending_.push_back(watch);
+        }
+    }
+
+    // Re-dispatches handlers that yielded before draining their descriptor
+    void dispatchPending() {
+        std::vector<Watch*> pending;
+        pending.swap(pending_);
+        for (Watch* watch : pending) {
+            watch->pending = false;
+            dispatch(watch, watch->events & (kReadable | kWritable));
+        }
+    }
+
+    int effectiveTimeout(int timeout_ms) const {
+        return pending_.empty() ? timeout_ms : 0;
+    }
+
+    void releaseRetired() {
+        if (retired_.empty()) return;
+        for (auto it = pending_.begin(); it != pending_.end();) {
+            it = (*it)->removed ? pending_.erase(it) : it + 1;
+        }
+        retired_.clear();
+    }
+
+    std::unordered_map<int, std::unique_ptr<Watch>> watches_;
+    std::vector<std::unique_ptr<Watch>> retired_;
+    std::vector<Watch*> pending_;
+    std::vector<int> timers_;
+};
+
+// Edge-triggered epoll backend; cost per wakeup scales with ready fds only
+class EpollEventLoop : public EventLoop {
+public:
+    EpollEventLoop() : epoll_fd_(epoll_create1(EPOLL_CLOEXEC)) {
+        if (epoll_fd_ == -1) {
+            throw std::runtime_error("epoll_create1 failed: " + std::string(std::strerror(errno)));
+        }
+    }
+
+    ~EpollEventLoop() override {
+        for (int fd : timers_) epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, fd, nullptr);
+        close(epoll_fd_);
+    }
+
+    void add(int fd, uint32_t events, Handler handler) override {
+        Watch* watch = insertWatch(fd, events, std::move(handler));
+        struct epoll_event ev = {};
+        ev.events = toEpoll(events);
+        ev.data.ptr = watch;
+        if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &ev) == -1) {
+            int err = errno;
+            eraseWatch(fd);
+            throw std::runtime_error("epoll_ctl ADD failed: " + std::string(std::strerror(err)));
+        }
+    }
+
+    void modify(int fd, uint32_t events) override {
+        Watch* watch = findWatch(fd);
+        if (!watch || watch->events == events) return;
+        watch->events = events;
+        struct epoll_event ev = {};
+        ev.events = toEpoll(events);
+        ev.data.ptr = watch;
+        epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, fd, &ev);
+    }
+
+    void remove(int fd) override {
+        if (!findWatch(fd)) return;
+        epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, fd, nullptr);
+        eraseWatch(fd);
+    }
+
+    void runOnce(int timeout_ms) override {
+        struct epoll_event events[64];
+        int count = epoll_wait(epoll_fd_, events, 64, effectiveTimeout(timeout_ms));
+        if (count == -1 && errno != EINTR) {
+            throw std::runtime_error("epoll_wait error: " + std::string(std::strerror(errno)));
+        }
+
+        dispatchPending();
+        for (int i = 0; i < count; ++i) {
+            dispatch(static_cast<Watch*>(events[i].data.ptr), fromEpoll(events[i].events));
+        }
+        releaseRetired();
+    }
+
+    const char* name() const override { return "epoll"; }
+
+private:
+    static uint32_t toEpoll(uint32_t events) {
+        uint32_t out = EPOLLET | EPOLLRDHUP;
+        if (events & kReadable) out |= EPOLLIN;
+        if (events & kWritable) out |= EPOLLOUT;
+        return out;
+    }
+
+    static uint32_t fromEpoll(uint32_t events) {
+        uint32_t out = 0;
+        if (events & EPOLLIN) out |= kReadable;
+        if (events & EPOLLOUT) out |= kWritable;
+        if (events & (EPOLLHUP | EPOLLERR | EPOLLRDHUP)) out |= kHangup;
+        return out;
+    }
+
+    int epoll_fd_;
+};
+
+// Level-triggered poll() backend kept as a portable fallback
+class PollEventLoop : public EventLoop {
+public:
+    void add(int fd, uint32_t events, Handler handler) override {
+        insertWatch(fd, events, std::move(handler));
+        dirty_ = true;
+    }
+
+    void modify(int fd, uint32_t events) override {
+        Watch* watch = findWatch(fd);
+        if (!watch || watch->events == events) return;
+        watch->events = events;
+        dirty_ = true;
+    }
+
+    void remove(int fd) override {
+        if (!findWatch(fd)) return;
+        eraseWatch(fd);
+        dirty_ = true;
+    }
+
+    void runOnce(int timeout_ms) override {
+        if (dirty_) rebuild();
+        if (poll(fds_.data(), fds_.size(), effectiveTimeout(timeout_ms)) == -1 && errno != EINTR) {
+            throw std::runtime_error("Poll error: " + std::string(std::strerror(errno)));
+        }
+
+        dispatchPending();
+        for (size_t i = 0; i < fds_.size(); ++i) {
+            short revents = fds_[i].revents;
+            if (!revents) continue;
+            uint32_t events = 0;
+            if (revents & POLLIN) events |= kReadable;
+            if (revents & POLLOUT) events |= kWritable;
+            if (revents & (POLLHUP | POLLERR | POLLNVAL)) events |= kHangup;
+            Watch* watch = slots_[i];
+            dispatch(watch, events);
+            // poll() reports a hang-up on every call; for a descriptor watched
+            // for nothing else (a paused master), report it once as epoll
+            // does and leave it out until it is modified
+            if ((events & kHangup) && !(watch->events & (kReadable | kWritable))) fds_[i].fd = -1;
+        }
+        releaseRetired();
+    }
+
+    const char* name() const override { return "poll"; }
+
+private:
+    void rebuild() {
+        fds_.clear();
+        slots_.clear();
+        for (auto& entry : watches_) {
+            short events = 0;
+            if (entry.second->events & kReadable) events |= POLLIN;
+            if (entry.second->events & kWritable) events |= POLLOUT;
+            fds_.push_back({entry.first, events, 0});
+            slots_.push_back(entry.second.get());
+        }
+        dirty_ = false;
+    }
+
+    std::vector<struct pollfd> fds_;
+    std::vector<Watch*> slots_;
+    bool dirty_ = true;
+};
+
+inline std::unique_ptr<EventLoop> EventLoop::create(const std::string& backend) {
+    if (backend == "epoll") return std::make_unique<EpollEventLoop>();
+    if (backend == "poll") return std::make_unique<PollEventLoop>();
+    throw std::runtime_error("Unknown event loop backend: " + backend);
+}
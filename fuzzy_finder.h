@@ -0,0 +1,228 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <signal.h>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <pthread.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <vector>
+
+#include "fuzzy_match.h"
+#include "history_rank.h"
+
+// Ranks the distinct commands of a HistoryRanking against a fuzzy query on
+// a pool of worker threads.
+//
+// Each of the ranking's blocks of entries is a shard. A worker scores a
+// shard with fuzzy::match() and keeps its best kMaxResults in a bounded
+// heap, breaking ties by frecency, then hands them back and wakes the event
+// loop through an eventfd. collect() merges the shards finished so far into
+// one bounded heap, so the results shown improve as shards arrive and are
+// never a full sort. Blocks never move and entry texts never change, so
+// workers read them without locking. A new query bumps the generation:
+// queued shards are dropped, running ones give up at their next check, and
+// late results are ignored.
+class FuzzyFinder {
+public:
+    static constexpr size_t kMaxResults = 64;
+    static constexpr unsigned kMaxThreads = 8;
+
+    struct Result {
+        int score;
+        double weight; // Frecency when scored
+        const HistoryRanking::Entry* entry;
+    };
+
+    explicit FuzzyFinder(const HistoryRanking& ranking) : ranking_(ranking) {
+        notify_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (notify_fd_ == -1) throw std::runtime_error("eventfd failed: " + std::string(std::strerror(errno)));
+        unsigned threads = std::max(1u, std::min(std::thread::hardware_concurrency(), kMaxThreads));
+        // Workers never handle signals: start them with everything blocked
+        sigset_t all, previous;
+        sigfillset(&all);
+        pthread_sigmask(SIG_BLOCK, &all, &previous);
+        try {
+            for (unsigned i = 0; i < threads; ++i) workers_.emplace_back([this] { run(); });
+        } catch (...) {
+            pthread_sigmask(SIG_SETMASK, &previous, nullptr);
+            stop();
+            throw;
+        }
+        pthread_sigmask(SIG_SETMASK, &previous, nullptr);
+    }
+
+    ~FuzzyFinder() { stop(); }
+
+    FuzzyFinder(const FuzzyFinder&) = delete;
+    FuzzyFinder& operator=(const FuzzyFinder&) = delete;
+
+    // Readable when collect() has finished shards to merge
+    int notifyFd() const { return notify_fd_; }
+
+    // Starts ranking against query, abandoning the previous query
+    void start(std::string_view query) {
+        cancel();
+        pattern_ = std::make_shared<const fuzzy::Pattern>(query);
+        size_t size = ranking_.size();
+        constexpr size_t kShardSize = HistoryRanking::kBlockSize;
+        for (size_t first = 0; first < size; first += kShardSize) {
+            dispatch(ranking_.block(first / kShardSize), std::min(kShardSize, size - first));
+        }
+    }
+
+    // Stops work on the current query
+    void cancel() {
+        heap_.clear();
+        outstanding_ = 0;
+        std::lock_guard<std::mutex> lock(mutex_);
+        generation_.fetch_add(1, std::memory_order_relaxed);
+        tasks_.clear();
+    }
+
+    // Merges the shards finished since the last call; returns whether the
+    // results changed
+    bool collect() {
+        eventfd_t value;
+        eventfd_read(notify_fd_, &value);
+        std::deque<Batch> done;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            done.swap(done_);
+        }
+        bool changed = false;
+        uint64_t generation = generation_.load(std::memory_order_relaxed);
+        for (Batch& batch : done) {
+            if (batch.generation != generation) continue;
+            --outstanding_;
+            for (const Result& r : batch.results) changed |= offer(heap_, r);
+        }
+        return changed;
+    }
+
+    // Whether every entry has been scored against the current query
+    bool done() const { return outstanding_ == 0; }
+
+    // The best results so far, best first
+    const std::vector<Result>& results() {
+        sorted_ = heap_;
+        std::sort_heap(sorted_.begin(), sorted_.end(), better);
+        return sorted_;
+    }
+
+private:
+    static constexpr size_t kCancelStride = 1024; // Entries scored between generation checks
+
+    struct Task {
+        uint64_t generation;
+        std::shared_ptr<const fuzzy::Pattern> pattern;
+        const HistoryRanking::Entry* entries;
+        size_t count;
+    };
+
+    struct Batch {
+        uint64_t generation;
+        std::vector<Result> results;
+    };
+
+    // Higher scores first, then higher frecency, then the earlier seen
+    static bool better(const Result& a, const Result& b) {
+        if (a.score != b.score) return a.score > b.score;
+        if (a.weight != b.weight) return a.weight > b.weight;
+        return a.entry->id < b.entry->id;
+    }
+
+    // Adds r to a heap of at most kMaxResults with the worst result on top;
+    // returns whether r was kept
+    static bool offer(std::vector<Result>& heap, const Result& r) {
+        if (heap.size() < kMaxResults) {
+            heap.push_back(r);
+            std::push_heap(heap.begin(), heap.end(), better);
+            return true;
+        }
+        if (!better(r, heap.front())) return false;
+        std::pop_heap(heap.begin(), heap.end(), better);
+        heap.back() = r;
+        std::push_heap(heap.begin(), heap.end(), better);
+        return true;
+    }
+
+    void dispatch(const HistoryRanking::Entry* entries, size_t count) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            tasks_.push_back(Task{generation_.load(std::memory_order_relaxed), pattern_, entries, count});
+        }
+        ++outstanding_;
+        wake_.notify_one();
+    }
+
+    void run() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        for (;;) {
+            wake_.wait(lock, [this] { return stopping_ || !tasks_.empty(); });
+            if (stopping_) return;
+            Task task = std::move(tasks_.front());
+            tasks_.pop_front();
+            lock.unlock();
+
+            Batch batch{task.generation, {}};
+            bool current = score(task, batch.results);
+            task = Task{};
+            lock.lock();
+            if (!current) continue;
+            done_.push_back(std::move(batch));
+            eventfd_write(notify_fd_, 1);
+        }
+    }
+
+    // Scores a shard into results; false if a newer query made it moot
+    bool score(const Task& task, std::vector<Result>& results) const {
+        for (size_t i = 0; i < task.count; ++i) {
+            if (i % kCancelStride == 0 && generation_.load(std::memory_order_relaxed) != task.generation) return false;
+            const HistoryRanking::Entry& e = task.entries[i];
+            int s = fuzzy::match(e.text, *task.pattern);
+            if (s != fuzzy::kNoMatch) offer(results, Result{s, e.weight.load(std::memory_order_relaxed), &e});
+        }
+        return true;
+    }
+
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        wake_.notify_all();
+        for (std::thread& worker : workers_) worker.join();
+        workers_.clear();
+        if (notify_fd_ != -1) close(notify_fd_);
+        notify_fd_ = -1;
+    }
+
+    const HistoryRanking& ranking_;
+    int notify_fd_ = -1;
+    std::vector<std::thread> workers_;
+
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::deque<Task> tasks_;
+    std::deque<Batch> done_;
+    bool stopping_ = false;
+    std::atomic<uint64_t> generation_{0};
+
+    // Main thread only
+    size_t outstanding_ = 0;   // Shards dispatched this generation and not collected
+    std::shared_ptr<const fuzzy::Pattern> pattern_;
+    std::vector<Result> heap_; // Best results so far, worst on top
+    std::vector<Result> sorted_;
+};
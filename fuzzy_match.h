@@ -0,0 +1,203 @@
+#pragma once
+
+#include <algorithm>
+#include <climits>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+#include "simd_scan.h"
+
+// Subsequence matching and scoring in the manner of fzf's v1 algorithm.
+//
+// A pattern matches text when its characters appear in order. Lowercase
+// patterns match either case; a pattern with an uppercase letter matches
+// exactly. The scan for each next pattern character compares 16 (SSE2) or
+// 32 (AVX2) bytes at a time against both cases of it, so text that does not
+// match, which is most of a history, is rejected at memchr speed. A match is
+// then narrowed to the shortest window ending where the forward scan ended
+// and scored: points per matched character, more at word boundaries, camel
+// humps and in consecutive runs, less across gaps.
+
+namespace fuzzy {
+
+constexpr int kScoreMatch = 16;
+constexpr int kScoreGapStart = -3;
+constexpr int kScoreGapExtension = -1;
+constexpr int kBonusBoundary = kScoreMatch / 2;
+constexpr int kBonusNonWord = kScoreMatch / 2;
+constexpr int kBonusCamel123 = kBonusBoundary - 1;
+constexpr int kBonusConsecutive = -(kScoreGapStart + kScoreGapExtension);
+constexpr int kBonusFirstCharMultiplier = 2;
+constexpr int kBonusBoundaryWhite = kBonusBoundary + 2;
+constexpr int kBonusBoundaryDelimiter = kBonusBoundary + 1;
+constexpr int kNoMatch = INT_MIN; // Gaps can make real scores negative
+
+// A query prepared for matching: each character with the byte it also
+// matches in the other case (the same byte when matching exactly)
+struct Pattern {
+    std::string chars;
+    std::string alternates;
+    bool exact = false;
+
+    explicit Pattern(std::string_view query) : chars(query), alternates(query) {
+        exact = std::any_of(query.begin(), query.end(), [](char c) { return c >= 'A' && c <= 'Z'; });
+        if (exact) return;
+        for (char& c : alternates) {
+            if (c >= 'a' && c <= 'z') c = static_cast<char>(c - 'a' + 'A');
+        }
+    }
+
+    bool empty() const { return chars.empty(); }
+    size_t size() const { return chars.size(); }
+};
+
+inline size_t findEitherScalar(const char* data, size_t count, char a, char b) {
+    size_t i = 0;
+    while (i < count && data[i] != a && data[i] != b) ++i;
+    return i;
+}
+
+#if defined(__SSE2__)
+inline size_t findEitherSse2(const char* data, size_t count, char a, char b) {
+    const __m128i va = _mm_set1_epi8(a);
+    const __m128i vb = _mm_set1_epi8(b);
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        __m128i hit = _mm_or_si128(_mm_cmpeq_epi8(chunk, va), _mm_cmpeq_epi8(chunk, vb));
+        unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(hit));
+        if (mask) return i + __builtin_ctz(mask);
+    }
+    return i + findEitherScalar(data + i, count - i, a, b);
+}
+#endif
+
+#if defined(SIMD_SCAN_HAVE_AVX2)
+__attribute__((target("avx2")))
+inline size_t findEitherAvx2(const char* data, size_t count, char a, char b) {
+    const __m256i va = _mm256_set1_epi8(a);
+    const __m256i vb = _mm256_set1_epi8(b);
+    size_t i = 0;
+    for (; i + 32 <= count; i += 32) {
+        __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+        __m256i hit = _mm256_or_si256(_mm256_cmpeq_epi8(chunk, va), _mm256_cmpeq_epi8(chunk, vb));
+        uint32_t mask = static_cast<uint32_t>(_mm256_movemask_epi8(hit));
+        if (mask) return i + __builtin_ctz(mask);
+    }
+    return i + findEitherSse2(data + i, count - i, a, b);
+}
+#endif
+
+using EitherFinder = size_t (*)(const char*, size_t, char, char);
+
+inline EitherFinder selectFindEither() {
+#if defined(SIMD_SCAN_HAVE_AVX2)
+    if (simd_scan::haveAvx2()) return findEitherAvx2;
+#endif
+#if defined(__SSE2__)
+    return findEitherSse2;
+#else
+    return findEitherScalar;
+#endif
+}
+
+inline const EitherFinder kFindEither = selectFindEither();
+
+// Offset of the first byte in data equal to a or b, or count
+inline size_t findEither(const char* data, size_t count, char a, char b) {
+    return kFindEither(data, count, a, b);
+}
+
+enum class CharClass : uint8_t { kWhite, kNonWord, kDelimiter, kLower, kUpper, kLetter, kNumber };
+
+inline CharClass charClass(char c) {
+    if (c >= 'a' && c <= 'z') return CharClass::kLower;
+    if (c >= 'A' && c <= 'Z') return CharClass::kUpper;
+    if (c >= '0' && c <= '9') return CharClass::kNumber;
+    if (c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' || c == '\f') return CharClass::kWhite;
+    if (c == '/' || c == ',' || c == ':' || c == ';' || c == '|') return CharClass::kDelimiter;
+    if (static_cast<unsigned char>(c) >= 0x80) return CharClass::kLetter; // Part of a UTF-8 character
+    return CharClass::kNonWord;
+}
+
+// Bonus for matching a character of class cur that follows one of class prev
+inline int bonusFor(CharClass prev, CharClass cur) {
+    if (cur > CharClass::kDelimiter) {
+        if (prev == CharClass::kWhite) return kBonusBoundaryWhite;
+        if (prev == CharClass::kDelimiter) return kBonusBoundaryDelimiter;
+        if (prev == CharClass::kNonWord) return kBonusBoundary;
+    }
+    if ((prev == CharClass::kLower && cur == CharClass::kUpper) ||
+        (prev != CharClass::kNumber && cur == CharClass::kNumber)) {
+        return kBonusCamel123;
+    }
+    if (cur == CharClass::kNonWord || cur == CharClass::kDelimiter) return kBonusNonWord;
+    if (cur == CharClass::kWhite) return kBonusBoundaryWhite;
+    return 0;
+}
+
+inline bool matchesAt(const Pattern& pattern, size_t p, char c) {
+    return c == pattern.chars[p] || c == pattern.alternates[p];
+}
+
+// Score of pattern against text[start, end), where the match is known to
+// start at start and end just before end
+inline int scoreWindow(std::string_view text, const Pattern& pattern, size_t start, size_t end) {
+    int score = 0;
+    int first_bonus = 0;
+    size_t consecutive = 0;
+    bool in_gap = false;
+    size_t p = 0;
+    CharClass prev = start > 0 ? charClass(text[start - 1]) : CharClass::kWhite;
+    for (size_t i = start; i < end; ++i) {
+        CharClass cls = charClass(text[i]);
+        if (p < pattern.size() && matchesAt(pattern, p, text[i])) {
+            score += kScoreMatch;
+            int bonus = bonusFor(prev, cls);
+            if (consecutive == 0) {
+                first_bonus = bonus;
+            } else {
+                // A run keeps the bonus of the boundary it started at
+                if (bonus >= kBonusBoundary && bonus > first_bonus) first_bonus = bonus;
+                bonus = std::max({bonus, first_bonus, kBonusConsecutive});
+            }
+            score += p == 0 ? bonus * kBonusFirstCharMultiplier : bonus;
+            in_gap = false;
+            ++consecutive;
+            ++p;
+        } else {
+            score += in_gap ? kScoreGapExtension : kScoreGapStart;
+            in_gap = true;
+            consecutive = 0;
+            first_bonus = 0;
+        }
+        prev = cls;
+    }
+    return score;
+}
+
+// Score of pattern in text, or kNoMatch when pattern is not a subsequence
+// of text. The empty pattern matches everything with 0.
+inline int match(std::string_view text, const Pattern& pattern) {
+    if (pattern.empty()) return 0;
+    // Forward: the earliest position each pattern character can take
+    size_t i = 0;
+    for (size_t p = 0; p < pattern.size(); ++p) {
+        i += findEither(text.data() + i, text.size() - i, pattern.chars[p], pattern.alternates[p]);
+        if (i == text.size()) return kNoMatch;
+        ++i;
+    }
+    size_t end = i;
+    // Backward from there: the latest start, for the shortest window
+    size_t start = end;
+    for (size_t p = pattern.size(); p-- > 0;) {
+        do {
+            --start;
+        } while (!matchesAt(pattern, p, text[start]));
+    }
+    return scoreWindow(text, pattern, start, end);
+}
+
+} // namespace fuzzy
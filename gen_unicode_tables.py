@@ -0,0 +1,211 @@
+#!/usr/bin/env python3
+"""Generates unicode_tables.h: cell widths and grapheme break properties.
+
+Run through `make unicode-tables`. Widths and general categories come from
+the unicodedata module of the Python running the script. The module does not
+carry Grapheme_Cluster_Break or Extended_Pictographic, so those are derived
+from the categories plus the short explicit lists below, taken from UAX #29
+and emoji-data.txt.
+
+Each codepoint gets one byte, width in the low two bits and break class
+above. The codepoint range is cut into equal blocks, identical blocks are
+stored once, and a first stage maps each block number to its copy. The
+block size is picked to make the two stages smallest.
+"""
+
+import sys
+import unicodedata
+
+MAX_CODEPOINT = 0x110000
+
+# Break classes, in the order of unicode::GraphemeBreak
+CLASSES = [
+    "Other", "CR", "LF", "Control", "Extend", "ZWJ", "RegionalIndicator", "Prepend",
+    "SpacingMark", "L", "V", "T", "LV", "LVT", "ExtendedPictographic",
+]
+
+# Other_Grapheme_Extend characters outside Mn and Me
+OTHER_EXTEND = [
+    (0x09BE, 0x09BE), (0x09D7, 0x09D7), (0x0B3E, 0x0B3E), (0x0B57, 0x0B57), (0x0BBE, 0x0BBE),
+    (0x0BD7, 0x0BD7), (0x0CC2, 0x0CC2), (0x0CD5, 0x0CD6), (0x0D3E, 0x0D3E), (0x0D57, 0x0D57),
+    (0x0DCF, 0x0DCF), (0x0DDF, 0x0DDF), (0x1B35, 0x1B35), (0x200C, 0x200C), (0x302E, 0x302F),
+    (0xFF9E, 0xFF9F), (0x1133E, 0x1133E), (0x11357, 0x11357), (0x114B0, 0x114B0),
+    (0x114BD, 0x114BD), (0x115AF, 0x115AF), (0x11930, 0x11930), (0x1D165, 0x1D165),
+    (0x1D16E, 0x1D172), (0x1F3FB, 0x1F3FF), (0xE0020, 0xE007F),
+]
+
+# Prepended_Concatenation_Mark and the Indic prefixed letters
+PREPEND = [
+    (0x0600, 0x0605), (0x06DD, 0x06DD), (0x070F, 0x070F), (0x0890, 0x0891), (0x08E2, 0x08E2),
+    (0x0D4E, 0x0D4E), (0x110BD, 0x110BD), (0x110CD, 0x110CD), (0x111C2, 0x111C3),
+    (0x1193F, 0x1193F), (0x11941, 0x11941), (0x11A3A, 0x11A3A), (0x11A84, 0x11A89),
+    (0x11D46, 0x11D46),
+]
+
+EXTENDED_PICTOGRAPHIC = [
+    (0x00A9, 0x00A9), (0x00AE, 0x00AE), (0x203C, 0x203C), (0x2049, 0x2049), (0x2122, 0x2122),
+    (0x2139, 0x2139), (0x2194, 0x2199), (0x21A9, 0x21AA), (0x231A, 0x231B), (0x2328, 0x2328),
+    (0x2388, 0x2388), (0x23CF, 0x23CF), (0x23E9, 0x23F3), (0x23F8, 0x23FA), (0x24C2, 0x24C2),
+    (0x25AA, 0x25AB), (0x25B6, 0x25B6), (0x25C0, 0x25C0), (0x25FB, 0x25FE), (0x2600, 0x2605),
+    (0x2607, 0x2612), (0x2614, 0x2685), (0x2690, 0x2705), (0x2708, 0x2712), (0x2714, 0x2714),
+    (0x2716, 0x2716), (0x271D, 0x271D), (0x2721, 0x2721), (0x2728, 0x2728), (0x2733, 0x2734),
+    (0x2744, 0x2744), (0x2747, 0x2747), (0x274C, 0x274C), (0x274E, 0x274E), (0x2753, 0x2755),
+    (0x2757, 0x2757), (0x2763, 0x2767), (0x2795, 0x2797), (0x27A1, 0x27A1), (0x27B0, 0x27B0),
+    (0x27BF, 0x27BF), (0x2934, 0x2935), (0x2B05, 0x2B07), (0x2B1B, 0x2B1C), (0x2B50, 0x2B50),
+    (0x2B55, 0x2B55), (0x3030, 0x3030), (0x303D, 0x303D), (0x3297, 0x3297), (0x3299, 0x3299),
+    (0x1F000, 0x1F0FF), (0x1F10D, 0x1F10F), (0x1F12F, 0x1F12F), (0x1F16C, 0x1F171),
+    (0x1F17E, 0x1F17F), (0x1F18E, 0x1F18E), (0x1F191, 0x1F19A), (0x1F1AD, 0x1F1E5),
+    (0x1F201, 0x1F20F), (0x1F21A, 0x1F21A), (0x1F22F, 0x1F22F), (0x1F232, 0x1F23A),
+    (0x1F23C, 0x1F23F), (0x1F249, 0x1F3FA), (0x1F400, 0x1F53D), (0x1F546, 0x1F64F),
+    (0x1F680, 0x1F6FF), (0x1F774, 0x1F77F), (0x1F7D5, 0x1F7FF), (0x1F80C, 0x1F80F),
+    (0x1F848, 0x1F84F), (0x1F85A, 0x1F85F), (0x1F888, 0x1F88F), (0x1F8AE, 0x1F8FF),
+    (0x1F90C, 0x1F93A), (0x1F93C, 0x1F945), (0x1F947, 0x1FAFF), (0x1FC00, 0x1FFFD),
+]
+
+# Unassigned codepoints here are reserved for wide ideographs
+WIDE_RESERVED = [(0x3400, 0x4DBF), (0x4E00, 0x9FFF), (0xF900, 0xFAFF), (0x20000, 0x2FFFD), (0x30000, 0x3FFFD)]
+
+# Hangul medial vowels and final consonants join the preceding syllable
+HANGUL_ZERO_WIDTH = [(0x1160, 0x11FF), (0xD7B0, 0xD7FF)]
+
+
+def in_ranges(cp, ranges):
+    return any(first <= cp <= last for first, last in ranges)
+
+
+def width(cp):
+    category = unicodedata.category(chr(cp))
+    if category == "Cc":
+        return 0  # Never printed; C1 controls are dropped rather than shown
+    if cp == 0x00AD:
+        return 1  # Soft hyphen is shown by terminals
+    if category in ("Mn", "Me", "Cf") or in_ranges(cp, HANGUL_ZERO_WIDTH):
+        return 0
+    if unicodedata.east_asian_width(chr(cp)) in ("W", "F"):
+        return 2
+    if 0x1F1E6 <= cp <= 0x1F1FF:
+        return 2  # Regional indicators have emoji presentation; pairs are drawn as wide flags
+    if category == "Cn" and in_ranges(cp, WIDE_RESERVED):
+        return 2
+    return 1
+
+
+def grapheme_break(cp):
+    if cp == 0x0D:
+        return "CR"
+    if cp == 0x0A:
+        return "LF"
+    if cp == 0x200D:
+        return "ZWJ"
+    if 0x1F1E6 <= cp <= 0x1F1FF:
+        return "RegionalIndicator"
+    if in_ranges(cp, PREPEND):
+        return "Prepend"
+    category = unicodedata.category(chr(cp))
+    if category in ("Mn", "Me") or in_ranges(cp, OTHER_EXTEND):
+        return "Extend"
+    if category in ("Cc", "Cf", "Cs", "Zl", "Zp"):
+        return "Control"
+    if 0x1100 <= cp <= 0x115F or 0xA960 <= cp <= 0xA97C:
+        return "L"
+    if 0x1160 <= cp <= 0x11A7 or 0xD7B0 <= cp <= 0xD7C6:
+        return "V"
+    if 0x11A8 <= cp <= 0x11FF or 0xD7CB <= cp <= 0xD7FB:
+        return "T"
+    if 0xAC00 <= cp <= 0xD7A3:
+        return "LV" if (cp - 0xAC00) % 28 == 0 else "LVT"
+    if category == "Mc" or cp in (0x0E33, 0x0EB3):
+        return "SpacingMark"
+    if in_ranges(cp, EXTENDED_PICTOGRAPHIC):
+        return "ExtendedPictographic"
+    return "Other"
+
+
+def split(values, shift):
+    """Returns (stage1, blocks) for blocks of 1 << shift values"""
+    size = 1 << shift
+    index = {}
+    stage1 = []
+    blocks = []
+    for start in range(0, len(values), size):
+        block = tuple(values[start:start + size])
+        if block not in index:
+            index[block] = len(blocks)
+            blocks.append(block)
+        stage1.append(index[block])
+    return stage1, blocks
+
+
+def table_bytes(stage1, blocks, shift):
+    return len(stage1) * (1 if len(blocks) <= 256 else 2) + (len(blocks) << shift)
+
+
+def emit_array(out, ctype, name, values, per_line=16):
+    out.append(f"inline constexpr {ctype} {name}[{len(values)}] = {{")
+    for start in range(0, len(values), per_line):
+        out.append("    " + ", ".join(str(v) for v in values[start:start + per_line]) + ",")
+    out.append("};")
+
+
+def main():
+    values = [width(cp) | CLASSES.index(grapheme_break(cp)) << 2 for cp in range(MAX_CODEPOINT)]
+    candidates = [(shift,) + split(values, shift) for shift in range(4, 11)]
+    shift, stage1, blocks = min(candidates, key=lambda c: table_bytes(c[1], c[2], c[0]))
+    stage1_type = "uint8_t" if len(blocks) <= 256 else "uint16_t"
+    total = table_bytes(stage1, blocks, shift)
+
+    out = [
+        "// Generated by gen_unicode_tables.py from Unicode "
+        f"{unicodedata.unidata_version}; do not edit. Regenerate with `make unicode-tables`.",
+        "#pragma once",
+        "",
+        "#include <cstddef>",
+        "#include <cstdint>",
+        "",
+        "namespace unicode {",
+        "",
+        "// Grapheme_Cluster_Break values (UAX #29), with Extended_Pictographic folded in",
+        "enum class GraphemeBreak : uint8_t {",
+    ]
+    out += [f"    k{name}," for name in CLASSES]
+    out += [
+        "};",
+        "",
+        "namespace detail {",
+        "",
+        f"// {len(blocks)} distinct blocks of {1 << shift} codepoints, {total} bytes in all.",
+        "// Each byte holds the cell width in bits 0-1 and the GraphemeBreak above.",
+        f"constexpr unsigned kBlockShift = {shift};",
+        "",
+    ]
+    emit_array(out, stage1_type, "kBlockIndex", stage1)
+    out.append("")
+    emit_array(out, "uint8_t", "kProperties", [v for block in blocks for v in block])
+    out += [
+        "",
+        "inline uint8_t properties(char32_t c) {",
+        "    if (c >= 0x110000) return 1; // Width 1, Other",
+        "    return kProperties[size_t{kBlockIndex[c >> kBlockShift]} << kBlockShift | (c & ((1u << kBlockShift) - 1))];",
+        "}",
+        "",
+        "} // namespace detail",
+        "",
+        "// Columns c occupies: 2 for wide and emoji presentation characters, 0 for",
+        "// combining marks, format characters and controls, otherwise 1",
+        "inline int width(char32_t c) {",
+        "    if (c < 0x7F) return c >= 0x20 ? 1 : 0;",
+        "    return detail::properties(c) & 3;",
+        "}",
+        "",
+        "inline GraphemeBreak graphemeBreak(char32_t c) {",
+        "    if (c >= 0x20 && c < 0x7F) return GraphemeBreak::kOther;",
+        "    return static_cast<GraphemeBreak>(detail::properties(c) >> 2);",
+        "}",
+        "",
+        "} // namespace unicode",
+    ]
+    sys.stdout.write("\n".join(out) + "\n")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,248 @@
+#pragma once
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "string_arena.h"
+
+// Command history that persists across sessions in an append-only file.
+//
+// Each record is a command's length, its bytes, then a trailer holding the
+// length again, a checksum and the time the command was run. Opening the log
+// maps the file and verifies only its last record; entries are indexed from
+// the newest back as navigation reaches them, so startup costs the same for
+// a thousand entries or ten million. An append is a single write() to the end
+// of the file, which concurrent sessions can share. A record torn by a crash
+// fails its trailer check. If it is last, the next open truncates the file
+// back to the whole record before it; if another session appended after it,
+// the backward walk steps over its bytes to the whole record before it.
+//
+// Logs written before records carried a time are still read and appended
+// to in their own format; their entries count as run when the file was last
+// modified.
+//
+// Entries added this session are copied into a StringArena. Both kinds of
+// entry are indexed by an 8-byte offset and length, and read as views of
+// the mapping or the arena without copying.
+class HistoryLog {
+public:
+    HistoryLog() = default;
+
+    ~HistoryLog() { close(); }
+
+    HistoryLog(const HistoryLog&) = delete;
+    HistoryLog& operator=(const HistoryLog&) = delete;
+
+    // Loads the log at path, creating it if needed. On failure the history
+    // lives in memory only and error says why.
+    bool open(const std::string& path, std::string& error) {
+        close();
+        fd_ = ::open(path.c_str(), O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0600);
+        if (fd_ == -1) return fail("Cannot open " + path + ": " + std::strerror(errno), error);
+
+        struct stat st;
+        if (fstat(fd_, &st) == -1) return fail("Cannot stat " + path + ": " + std::strerror(errno), error);
+        size_t size = static_cast<size_t>(st.st_size);
+        if (size == 0) {
+            if (::write(fd_, kMagic, kHeaderSize) != static_cast<ssize_t>(kHeaderSize)) {
+                return fail("Cannot write " + path + ": " + std::strerror(errno), error);
+            }
+            size = kHeaderSize;
+        }
+        if (!map(size)) return fail(path + " is not a history log", error);
+        if (std::memcmp(data_, kMagicUntimed, kHeaderSize) == 0) {
+            timed_ = false;
+            modified_ = static_cast<int64_t>(st.st_mtime);
+        } else if (std::memcmp(data_, kMagic, kHeaderSize) != 0) {
+            return fail(path + " is not a history log", error);
+        }
+        if (size > kHeaderSize && !recordEndingAt(size, nullptr, nullptr)) {
+            // Torn by a crash mid-append: keep the whole records before it
+            size_t end = resync(size);
+            if (ftruncate(fd_, static_cast<off_t>(end)) == -1 || !map(end)) {
+                return fail("Cannot repair " + path + ": " + std::strerror(errno), error);
+            }
+        }
+        indexed_to_ = size_;
+        return true;
+    }
+
+    // Sets out to entry back entries before the newest (0 is the newest),
+    // and time, if given, to when it was run in seconds since the epoch;
+    // returns false past the oldest. Views stay valid until close.
+    bool entry(size_t back, std::string_view& out, int64_t* time = nullptr) {
+        if (back < session_.size()) {
+            size_t i = session_.size() - 1 - back;
+            const Span& e = session_[i];
+            out = arena_.view(e.offset, e.length);
+            if (time) *time = session_times_[i];
+            return true;
+        }
+        back -= session_.size();
+        while (index_.size() <= back) {
+            size_t offset;
+            size_t length;
+            if (indexed_to_ <= kHeaderSize) return false;
+            if (!recordEndingAt(indexed_to_, &offset, &length)) {
+                // Torn by a session that died while others kept appending
+                indexed_to_ = resync(indexed_to_);
+                continue;
+            }
+            if (length > kMaxLength) length = kMaxLength;
+            index_.push_back(Span{offset, length});
+            indexed_to_ = offset - sizeof(uint32_t);
+        }
+        const Span& e = index_[back];
+        out = std::string_view(data_ + e.offset, e.length);
+        if (time) *time = timed_ ? recordTime(e) : modified_;
+        return true;
+    }
+
+    // Entries added since open(); they are the newest
+    size_t sessionEntries() const { return session_.size(); }
+
+    // Adds command, run at time, as the newest entry and appends it to the
+    // file. Commands longer than kMaxLength are cut there.
+    void append(std::string_view command, int64_t time) {
+        command = command.substr(0, kMaxLength);
+        session_.push_back(Span{arena_.store(command), command.size()});
+        session_times_.push_back(time);
+        if (fd_ == -1) return;
+
+        uint32_t length = static_cast<uint32_t>(command.size());
+        Trailer trailer{length, checksum(command.data(), command.size()), time};
+        if (timed_) trailer.checksum = mixTime(trailer.checksum, time);
+        size_t trailer_size = timed_ ? sizeof(Trailer) : kUntimedTrailerSize;
+        struct iovec iov[3] = {
+            {&length, sizeof(length)},
+            {const_cast<char*>(command.data()), command.size()},
+            {&trailer, trailer_size},
+        };
+        ssize_t expected = static_cast<ssize_t>(sizeof(length) + command.size() + trailer_size);
+        if (writev(fd_, iov, 3) != expected) {
+            // A partial record is repaired at the next open; nothing may follow it
+            ::close(fd_);
+            fd_ = -1;
+        }
+    }
+
+private:
+    static constexpr char kMagic[] = "TEHIST2\n";
+    static constexpr char kMagicUntimed[] = "TEHIST1\n"; // Records without a time
+    static constexpr size_t kHeaderSize = sizeof(kMagic) - 1;
+    static constexpr size_t kMaxLength = StringArena::kMaxLength;
+
+    struct Trailer {
+        uint32_t length;
+        uint32_t checksum;
+        int64_t time; // Absent from untimed logs
+    };
+    static constexpr size_t kUntimedTrailerSize = offsetof(Trailer, time);
+
+    // Where an entry's bytes are in the mapping or the arena
+    struct Span {
+        uint64_t offset : 40;
+        uint64_t length : 24;
+    };
+    static_assert(kMaxLength < (1u << 24), "entry lengths fit a Span");
+
+    static uint32_t checksum(const char* data, size_t size) {
+        uint32_t h = 2166136261u ^ static_cast<uint32_t>(size);
+        for (size_t i = 0; i < size; ++i) h = (h ^ static_cast<unsigned char>(data[i])) * 16777619u;
+        return h;
+    }
+
+    static uint32_t mixTime(uint32_t h, int64_t time) {
+        uint64_t t = static_cast<uint64_t>(time);
+        for (int i = 0; i < 8; ++i) h = (h ^ static_cast<uint8_t>(t >> (8 * i))) * 16777619u;
+        return h;
+    }
+
+    size_t trailerSize() const { return timed_ ? sizeof(Trailer) : kUntimedTrailerSize; }
+
+    int64_t recordTime(const Span& e) const {
+        int64_t time;
+        std::memcpy(&time, data_ + e.offset + e.length + kUntimedTrailerSize, sizeof(time));
+        return time;
+    }
+
+    bool fail(const std::string& message, std::string& error) {
+        error = message;
+        close();
+        return false;
+    }
+
+    void close() {
+        if (data_) munmap(const_cast<char*>(data_), size_);
+        data_ = nullptr;
+        size_ = 0;
+        if (fd_ != -1) ::close(fd_);
+        fd_ = -1;
+        index_.clear();
+        indexed_to_ = 0;
+        timed_ = true;
+    }
+
+    // Maps the first size bytes of the file; the mapping never grows, since
+    // this session's appends are served from memory
+    bool map(size_t size) {
+        if (data_) munmap(const_cast<char*>(data_), size_);
+        data_ = nullptr;
+        size_ = 0;
+        if (size < kHeaderSize) return false;
+        void* p = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd_, 0);
+        if (p == MAP_FAILED) return false;
+        data_ = static_cast<const char*>(p);
+        size_ = size;
+        return true;
+    }
+
+    // Whether a whole record ends at end; if so, where its command is
+    bool recordEndingAt(size_t end, size_t* offset, size_t* length) const {
+        size_t trailer_size = trailerSize();
+        size_t overhead = sizeof(uint32_t) + trailer_size;
+        if (end > size_ || end < kHeaderSize + overhead) return false;
+        Trailer trailer;
+        std::memcpy(&trailer, data_ + end - trailer_size, trailer_size);
+        if (trailer.length > end - kHeaderSize - overhead) return false;
+        size_t start = end - trailer_size - trailer.length;
+        uint32_t leading;
+        std::memcpy(&leading, data_ + start - sizeof(uint32_t), sizeof(leading));
+        if (leading != trailer.length) return false; // Checked first: resync() tries every byte
+        uint32_t sum = checksum(data_ + start, trailer.length);
+        if (timed_) sum = mixTime(sum, trailer.time);
+        if (sum != trailer.checksum) return false;
+        if (offset) *offset = start;
+        if (length) *length = trailer.length;
+        return true;
+    }
+
+    // End of the last whole record before end, stepping back a byte at a
+    // time over torn ones; kHeaderSize if there is none
+    size_t resync(size_t end) const {
+        while (end > kHeaderSize && !recordEndingAt(end, nullptr, nullptr)) --end;
+        return end;
+    }
+
+    int fd_ = -1;
+    const char* data_ = nullptr;       // File contents as of open()
+    size_t size_ = 0;
+    bool timed_ = true;                // Records carry the time they were run
+    int64_t modified_ = 0;             // Time given to entries of an untimed log
+    std::deque<Span> index_;           // Mapped entries found so far, newest first
+    size_t indexed_to_ = 0;            // End of the newest record not yet indexed
+    StringArena arena_;                // Bytes of the entries added since open()
+    std::vector<Span> session_;        // Entries added since open(), oldest first
+    std::vector<int64_t> session_times_;
+};
@@ -0,0 +1,217 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "history_log.h"
+
+// Deduplicated command history ranked by frecency.
+//
+// Each distinct command is one Entry, found through a hash table on its
+// text, holding how often and when last it was run. The table is split into
+// kShards by hash, so growing it rehashes one small shard at a time rather
+// than every command at once. Its frecency is the sum
+// over its runs of 2^(t / kHalfLife), so every run counts and counts half as
+// much for each half-life since. All sums decay at the same rate, so the
+// order between two entries changes only when one is run again; the sum is
+// kept as its base-2 logarithm and never needs revisiting. Entries sit in
+// buckets of 1/kLevelsPerHalfLife half-life each, most recently run first,
+// and a run moves one entry to the front of its new bucket: constant time
+// per command. Walking the buckets down from the highest gives the ranking.
+//
+// The log's earlier entries are folded in newest first, by time-bounded
+// load() steps run between events, so opening a long history stays free.
+// Runs found this way are older than any entry already placed, so an entry
+// they create or move goes to the back of its bucket instead.
+//
+// Entries live in fixed-size blocks and are never removed, so pointers and
+// ids stay valid; an entry's text and weight may be read from other threads
+// while the ranking changes.
+class HistoryRanking {
+public:
+    static constexpr size_t kBlockSize = 8192;
+
+    struct Entry {
+        std::string_view text;         // Points into the log
+        uint32_t id = 0;               // Entries are numbered as they are first seen
+        uint32_t count = 0;            // Times run
+        int64_t last_used = 0;         // Seconds since the epoch
+        std::atomic<double> weight{0}; // log2 of the frecency sum
+        size_t level = 0;              // Bucket index
+        Entry* prev = nullptr;         // Neighbours in the bucket
+        Entry* next = nullptr;
+    };
+
+    explicit HistoryRanking(HistoryLog& log) : log_(log) {}
+
+    HistoryRanking(const HistoryRanking&) = delete;
+    HistoryRanking& operator=(const HistoryRanking&) = delete;
+
+    // Records a run of text, which must stay valid as long as the log, at
+    // time; returns its entry
+    const Entry* use(std::string_view text, int64_t time) {
+        Entry* e = find(text);
+        if (!e) return add(text, time, true);
+        ++e->count;
+        e->last_used = std::max(e->last_used, time);
+        unlink(e);
+        e->weight.store(addWeight(e->weight.load(std::memory_order_relaxed), time), std::memory_order_relaxed);
+        link(e, true);
+        return e;
+    }
+
+    // Folds in more of the log's earlier entries for a bounded time; returns
+    // true while some remain
+    bool load() {
+        if (loaded_all_) return false;
+        std::string_view text;
+        int64_t time;
+        auto deadline = std::chrono::steady_clock::now() + kLoadTime;
+        for (size_t n = 1;; ++n) {
+            if (!log_.entry(log_.sessionEntries() + loaded_, text, &time)) {
+                loaded_all_ = true;
+                return false;
+            }
+            ++loaded_;
+            if (Entry* e = find(text)) {
+                ++e->count;
+                e->last_used = std::max(e->last_used, time);
+                double weight = addWeight(e->weight.load(std::memory_order_relaxed), time);
+                e->weight.store(weight, std::memory_order_relaxed);
+                if (levelOf(weight) != e->level) {
+                    unlink(e);
+                    link(e, false);
+                }
+            } else {
+                add(text, time, false);
+            }
+            if (n % kClockStride == 0 && std::chrono::steady_clock::now() >= deadline) return true;
+        }
+    }
+
+    bool loaded() const { return loaded_all_; }
+
+    // Distinct commands seen so far
+    size_t size() const { return size_; }
+
+    // Entries with ids from index * kBlockSize, up to size()
+    const Entry* block(size_t index) const { return blocks_[index].get(); }
+
+    const Entry* entry(size_t id) const { return &blocks_[id / kBlockSize][id % kBlockSize]; }
+
+    // The highest ranked entry, or null when empty
+    const Entry* first() const { return top_ < buckets_.size() ? buckets_[top_].head : nullptr; }
+
+    // The entry ranked after e, or null after the last
+    const Entry* next(const Entry* e) const {
+        if (e->next) return e->next;
+        for (size_t level = e->level; level-- > 0;) {
+            if (buckets_[level].head) return buckets_[level].head;
+        }
+        return nullptr;
+    }
+
+    // The entry ranked before e, or null before the first
+    const Entry* prev(const Entry* e) const {
+        if (e->prev) return e->prev;
+        for (size_t level = e->level + 1; level <= top_ && level < buckets_.size(); ++level) {
+            if (buckets_[level].tail) return buckets_[level].tail;
+        }
+        return nullptr;
+    }
+
+private:
+    static constexpr double kHalfLife = 7 * 24 * 3600; // Seconds
+    static constexpr double kLevelsPerHalfLife = 4;
+    static constexpr std::chrono::microseconds kLoadTime{300};
+    static constexpr size_t kClockStride = 64; // Entries loaded between clock reads
+    static constexpr size_t kShardBits = 10;
+    static constexpr size_t kShards = size_t{1} << kShardBits;
+
+    struct Bucket {
+        Entry* head = nullptr;
+        Entry* tail = nullptr;
+    };
+
+    // log2(2^weight + 2^(time / kHalfLife)), without overflowing
+    static double addWeight(double weight, int64_t time) {
+        double x = static_cast<double>(time) / kHalfLife;
+        double high = std::max(weight, x);
+        return high + std::log2(1 + std::exp2(-std::fabs(weight - x)));
+    }
+
+    static size_t levelOf(double weight) {
+        return weight > 0 ? static_cast<size_t>(weight * kLevelsPerHalfLife) : 0;
+    }
+
+    // The shard is chosen by the hash's top bits; within it the table uses
+    // the low bits
+    std::unordered_map<std::string_view, Entry*>& shard(std::string_view text) {
+        return entries_[std::hash<std::string_view>{}(text) >> (sizeof(size_t) * 8 - kShardBits)];
+    }
+
+    Entry* find(std::string_view text) {
+        auto& entries = shard(text);
+        auto it = entries.find(text);
+        return it == entries.end() ? nullptr : it->second;
+    }
+
+    Entry* add(std::string_view text, int64_t time, bool recent) {
+        if (size_ % kBlockSize == 0) blocks_.emplace_back(new Entry[kBlockSize]);
+        Entry* e = &blocks_.back()[size_ % kBlockSize];
+        e->text = text;
+        e->id = static_cast<uint32_t>(size_++);
+        e->count = 1;
+        e->last_used = time;
+        e->weight.store(static_cast<double>(std::max<int64_t>(time, 0)) / kHalfLife, std::memory_order_relaxed);
+        shard(text).emplace(text, e);
+        link(e, recent);
+        return e;
+    }
+
+    // Places e in the bucket for its weight, at the front if it was just run
+    void link(Entry* e, bool front) {
+        e->level = levelOf(e->weight.load(std::memory_order_relaxed));
+        if (e->level >= buckets_.size()) buckets_.resize(e->level + 1);
+        Bucket& b = buckets_[e->level];
+        if (front) {
+            e->prev = nullptr;
+            e->next = b.head;
+            (b.head ? b.head->prev : b.tail) = e;
+            b.head = e;
+        } else {
+            e->next = nullptr;
+            e->prev = b.tail;
+            (b.tail ? b.tail->next : b.head) = e;
+            b.tail = e;
+        }
+        if (top_ >= buckets_.size() || e->level > top_) top_ = e->level;
+    }
+
+    void unlink(Entry* e) {
+        Bucket& b = buckets_[e->level];
+        (e->prev ? e->prev->next : b.head) = e->next;
+        (e->next ? e->next->prev : b.tail) = e->prev;
+        e->prev = e->next = nullptr;
+        // An emptied top bucket passes the top down to the next non-empty one
+        while (top_ < buckets_.size() && !buckets_[top_].head) top_ = top_ > 0 ? top_ - 1 : SIZE_MAX;
+    }
+
+    HistoryLog& log_;
+    std::vector<std::unordered_map<std::string_view, Entry*>> entries_ =
+        std::vector<std::unordered_map<std::string_view, Entry*>>(kShards);
+    std::vector<std::unique_ptr<Entry[]>> blocks_;
+    size_t size_ = 0;
+    std::vector<Bucket> buckets_;  // Indexed by level
+    size_t top_ = SIZE_MAX;        // Highest non-empty level, SIZE_MAX when empty
+    size_t loaded_ = 0;            // Earlier entries folded in
+    bool loaded_all_ = false;
+};
@@ -0,0 +1,235 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "history_rank.h"
+
+// Sorted entry ids of one trigram. Ids are kept in segments of at most
+// kSegment, so a list that grows to millions of ids never copies them all
+// to reallocate while a keystroke waits.
+class PostingList {
+public:
+    static constexpr size_t kSegmentBits = 12;
+    static constexpr size_t kSegment = size_t{1} << kSegmentBits;
+
+    void push_back(uint32_t id) {
+        if (size_ % kSegment == 0) segments_.emplace_back();
+        segments_.back().push_back(id);
+        ++size_;
+    }
+
+    size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+    uint32_t back() const { return segments_.back().back(); }
+    uint32_t operator[](size_t i) const { return segments_[i >> kSegmentBits][i & (kSegment - 1)]; }
+
+    // First index in [first, last) whose id is at least id (above id when
+    // after is set), or last
+    size_t bound(uint32_t id, size_t first, size_t last, bool after) const {
+        while (first < last) {
+            size_t mid = first + (last - first) / 2;
+            uint32_t v = (*this)[mid];
+            if (v < id || (after && v == id)) {
+                first = mid + 1;
+            } else {
+                last = mid;
+            }
+        }
+        return first;
+    }
+
+private:
+    std::vector<std::vector<uint32_t>> segments_;
+    size_t size_ = 0;
+};
+
+// Inverted index from each three-byte sequence to the entries containing it.
+// Entries are numbered in the order they are added, so every posting list
+// is sorted and only ever grows at its end.
+class TrigramIndex {
+public:
+    static constexpr size_t kGram = 3;
+
+    void add(std::string_view text) {
+        uint32_t id = static_cast<uint32_t>(count_++);
+        for (size_t i = 0; i + kGram <= text.size(); ++i) {
+            PostingList& list = postings_[key(text.data() + i)];
+            if (list.empty() || list.back() != id) list.push_back(id);
+        }
+    }
+
+    // Entries indexed so far
+    size_t size() const { return count_; }
+
+    // Calls visit(id) for each entry holding every trigram of query, starting
+    // at from and moving toward lower ids when descending, higher otherwise,
+    // until visit returns true. Queries shorter than a trigram visit every
+    // entry. Returns whether visit stopped the walk.
+    template <typename Visit>
+    bool candidates(std::string_view query, size_t from, bool descending, Visit&& visit) {
+        if (count_ == 0) return false;
+        if (from >= count_) {
+            if (!descending) return false;
+            from = count_ - 1;
+        }
+        if (query.size() < kGram) {
+            if (descending) {
+                for (size_t id = from + 1; id-- > 0;) {
+                    if (visit(static_cast<uint32_t>(id))) return true;
+                }
+            } else {
+                for (size_t id = from; id < count_; ++id) {
+                    if (visit(static_cast<uint32_t>(id))) return true;
+                }
+            }
+            return false;
+        }
+
+        lists_.clear();
+        for (size_t i = 0; i + kGram <= query.size(); ++i) {
+            auto it = postings_.find(key(query.data() + i));
+            if (it == postings_.end()) return false;
+            lists_.push_back(&it->second);
+        }
+        // The rarest list drives the walk; the others are probed with
+        // cursors that only move forward in the walk's direction
+        std::sort(lists_.begin(), lists_.end(), [](const PostingList* a, const PostingList* b) {
+            return a->size() != b->size() ? a->size() < b->size() : a < b;
+        });
+        lists_.erase(std::unique(lists_.begin(), lists_.end()), lists_.end());
+        const PostingList& rarest = *lists_[0];
+        uint32_t limit = static_cast<uint32_t>(from);
+
+        if (descending) {
+            cursors_.clear();
+            for (const PostingList* list : lists_) cursors_.push_back(list->size());
+            for (size_t i = rarest.bound(limit, 0, rarest.size(), true); i-- > 0;) {
+                uint32_t id = rarest[i];
+                if (inAllDescending(id) && visit(id)) return true;
+            }
+        } else {
+            cursors_.assign(lists_.size(), 0);
+            for (size_t i = rarest.bound(limit, 0, rarest.size(), false); i < rarest.size(); ++i) {
+                uint32_t id = rarest[i];
+                if (inAllAscending(id) && visit(id)) return true;
+            }
+        }
+        return false;
+    }
+
+private:
+    static uint32_t key(const char* p) {
+        return uint32_t{static_cast<unsigned char>(p[0])} << 16 | uint32_t{static_cast<unsigned char>(p[1])} << 8 |
+               static_cast<unsigned char>(p[2]);
+    }
+
+    // Whether every other list holds id, with cursors_ as upper bounds
+    bool inAllDescending(uint32_t id) {
+        for (size_t k = 1; k < lists_.size(); ++k) {
+            const PostingList& list = *lists_[k];
+            size_t i = list.bound(id, 0, cursors_[k], true);
+            cursors_[k] = i;
+            if (i == 0 || list[i - 1] != id) return false;
+        }
+        return true;
+    }
+
+    // Whether every other list holds id, with cursors_ as lower bounds
+    bool inAllAscending(uint32_t id) {
+        for (size_t k = 1; k < lists_.size(); ++k) {
+            const PostingList& list = *lists_[k];
+            size_t i = list.bound(id, cursors_[k], list.size(), false);
+            cursors_[k] = i;
+            if (i == list.size() || list[i] != id) return false;
+        }
+        return true;
+    }
+
+    size_t count_ = 0;
+    std::unordered_map<uint32_t, PostingList> postings_;
+    std::vector<const PostingList*> lists_; // Scratch for candidates()
+    std::vector<size_t> cursors_;
+};
+
+// Incremental search over a HistoryRanking, in ranked order.
+//
+// A trigram index over the distinct commands, numbered by entry id, narrows
+// each query to the entries holding all its trigrams. The index grows by
+// time-bounded slices as commands are added. For each new query the
+// candidates are marked in a bitmap, and find() walks the ranking from a
+// cursor, checking only marked entries and those not yet indexed. Each call
+// does a bounded amount of work: when its budget runs out without a match it
+// returns kPending, and the caller calls again from where it stopped,
+// staying responsive to keystrokes in between.
+class HistorySearch {
+public:
+    enum class Result { kFound, kNotFound, kPending };
+    using Entry = HistoryRanking::Entry;
+
+    explicit HistorySearch(HistoryRanking& ranking) : ranking_(ranking) {}
+
+    // Looks for the next entry containing query, ranked after cursor (from
+    // the first when null). On kFound, cursor is the match; on kPending, the
+    // entry to continue after.
+    Result find(std::string_view query, const Entry*& cursor) {
+        indexMore();
+        if (query != query_) filter(query);
+
+        size_t visits = kVisitBudget;
+        size_t checks = kCheckBudget;
+        for (const Entry* e = cursor ? ranking_.next(cursor) : ranking_.first(); e; cursor = e, e = ranking_.next(e)) {
+            if (--visits == 0) return Result::kPending;
+            if (query.size() >= TrigramIndex::kGram && e->id < candidates_.size() && !candidates_[e->id]) continue;
+            if (e->text.find(query) != std::string_view::npos) {
+                cursor = e;
+                return Result::kFound;
+            }
+            if (--checks == 0) {
+                cursor = e;
+                return Result::kPending;
+            }
+        }
+        return Result::kNotFound;
+    }
+
+private:
+    // Entries walked and candidates checked per call, and time spent
+    // indexing per call; each is well under a millisecond of work. The walk
+    // follows ranking links scattered across the blocks, a cache miss a step.
+    static constexpr size_t kVisitBudget = 1 << 15;
+    static constexpr size_t kCheckBudget = 16384;
+    static constexpr std::chrono::microseconds kIndexTime{300};
+    static constexpr size_t kClockStride = 64; // Entries indexed between clock reads
+
+    // Indexes the next slice of entries not yet indexed
+    void indexMore() {
+        auto deadline = std::chrono::steady_clock::now() + kIndexTime;
+        for (size_t n = 1; index_.size() < ranking_.size(); ++n) {
+            index_.add(ranking_.entry(index_.size())->text);
+            if (n % kClockStride == 0 && std::chrono::steady_clock::now() >= deadline) return;
+        }
+    }
+
+    // Marks the indexed entries holding every trigram of query
+    void filter(std::string_view query) {
+        query_.assign(query.data(), query.size());
+        candidates_.assign(index_.size(), 0);
+        if (query.size() < TrigramIndex::kGram) return;
+        index_.candidates(query, 0, false, [this](uint32_t id) {
+            candidates_[id] = 1;
+            return false;
+        });
+    }
+
+    HistoryRanking& ranking_;
+    TrigramIndex index_;              // Entry texts by id
+    std::string query_;               // Query candidates_ was built for
+    std::vector<uint8_t> candidates_; // By id, for the ids indexed when built
+};
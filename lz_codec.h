@@ -0,0 +1,117 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// Small LZ77 block codec in the style of LZ4: greedy matching through a
+// hash table of 4-byte sequences, 16-bit offsets, and token bytes carrying
+// the literal and match lengths. Fast enough to run on every cold
+// scrollback page, and decoding checks every bound so a damaged block fails
+// instead of overrunning.
+namespace lz {
+
+constexpr size_t kMinMatch = 4;
+constexpr size_t kLastLiterals = 5; // The block always ends with literals
+constexpr size_t kMaxOffset = 65535;
+constexpr int kHashBits = 12;
+
+inline uint32_t load32(const uint8_t* p) {
+    uint32_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+inline uint32_t hash(uint32_t sequence) {
+    return (sequence * 2654435761u) >> (32 - kHashBits);
+}
+
+inline void putLength(std::vector<uint8_t>& out, size_t length) {
+    while (length >= 255) {
+        out.push_back(255);
+        length -= 255;
+    }
+    out.push_back(static_cast<uint8_t>(length));
+}
+
+inline void putSequence(std::vector<uint8_t>& out, const uint8_t* literals, size_t literal_length,
+                        size_t offset, size_t match_length) {
+    size_t match_code = match_length ? match_length - kMinMatch : 0;
+    uint8_t token = static_cast<uint8_t>((literal_length < 15 ? literal_length : 15) << 4 |
+                                         (match_code < 15 ? match_code : 15));
+    out.push_back(token);
+    if (literal_length >= 15) putLength(out, literal_length - 15);
+    out.insert(out.end(), literals, literals + literal_length);
+    if (match_length == 0) return;
+    out.push_back(static_cast<uint8_t>(offset));
+    out.push_back(static_cast<uint8_t>(offset >> 8));
+    if (match_code >= 15) putLength(out, match_code - 15);
+}
+
+// Appends the compressed form of src to out
+inline void compress(const uint8_t* src, size_t size, std::vector<uint8_t>& out) {
+    uint32_t table[1u << kHashBits] = {};
+    size_t anchor = 0;
+    size_t ip = 0;
+    size_t limit = size > kMinMatch + kLastLiterals ? size - kMinMatch - kLastLiterals : 0;
+
+    while (ip < limit) {
+        uint32_t sequence = load32(src + ip);
+        uint32_t& slot = table[hash(sequence)];
+        size_t candidate = slot;
+        slot = static_cast<uint32_t>(ip);
+        if (candidate >= ip || ip - candidate > kMaxOffset || load32(src + candidate) != sequence) {
+            // Step faster through data that keeps failing to match
+            ip += 1 + ((ip - anchor) >> 6);
+            continue;
+        }
+        size_t length = kMinMatch;
+        while (ip + length < size - kLastLiterals && src[candidate + length] == src[ip + length]) ++length;
+        putSequence(out, src + anchor, ip - anchor, ip - candidate, length);
+        ip += length;
+        anchor = ip;
+    }
+    putSequence(out, src + anchor, size - anchor, 0, 0);
+}
+
+// Decodes a block produced by compress() into exactly size bytes at dst
+inline bool decompress(const uint8_t* src, size_t length, uint8_t* dst, size_t size) {
+    const uint8_t* in = src;
+    const uint8_t* in_end = src + length;
+    size_t op = 0;
+
+    auto readLength = [&](size_t& value) {
+        uint8_t byte;
+        do {
+            if (in == in_end) return false;
+            byte = *in++;
+            value += byte;
+        } while (byte == 255);
+        return true;
+    };
+
+    while (in < in_end) {
+        uint8_t token = *in++;
+        size_t literal_length = token >> 4;
+        if (literal_length == 15 && !readLength(literal_length)) return false;
+        if (literal_length > static_cast<size_t>(in_end - in) || literal_length > size - op) return false;
+        std::memcpy(dst + op, in, literal_length);
+        in += literal_length;
+        op += literal_length;
+        if (in == in_end) break; // Final literals-only sequence
+
+        if (in_end - in < 2) return false;
+        size_t offset = in[0] | in[1] << 8;
+        in += 2;
+        size_t match_length = (token & 15);
+        if (match_length == 15 && !readLength(match_length)) return false;
+        match_length += kMinMatch;
+        if (offset == 0 || offset > op || match_length > size - op) return false;
+        // Byte by byte: matches may overlap the bytes they produce
+        for (size_t i = 0; i < match_length; ++i, ++op) dst[op] = dst[op - offset];
+    }
+    return op == size;
+}
+
+} // namespace lz
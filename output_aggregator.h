@@ -0,0 +1,347 @@
+#pragma once
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <unistd.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/uio.h>
+
+// What a bounded queue does with output that arrives while it is full
+enum class OverflowPolicy {
+    kBlock, // Keep queueing; the caller stops producing (e.g. pauses PTY reads)
+    kDrop,  // Discard the new output
+    kSpill, // Append to an unlinked temporary file and replay it later
+};
+
+// Outcome of flushing one descriptor
+enum class FlushResult {
+    kFlushed, // Everything queued was written
+    kBlocked, // The descriptor would block; the remainder stays queued
+    kFailed,  // A write error occurred; the queue was discarded
+};
+
+// Collects the writes a loop iteration produces for each descriptor and
+// flushes every descriptor with as few writev() calls as possible.
+//
+// Small writes are copied into per-descriptor storage; queueRef() queues a
+// caller-owned buffer without copying, which must stay valid until the next
+// flush of that descriptor. Flushing never waits: when a non-blocking
+// descriptor fills up, the unwritten tail is kept in place (referenced
+// buffers are copied, once) until the caller sees the descriptor writable
+// again. A queue can be given a byte limit and an OverflowPolicy to bound
+// its memory.
+class OutputAggregator {
+public:
+    OutputAggregator() = default;
+    OutputAggregator(const OutputAggregator&) = delete;
+    OutputAggregator& operator=(const OutputAggregator&) = delete;
+
+    ~OutputAggregator() {
+        for (auto& entry : queues_) entry.second.closeSpill();
+    }
+
+    // Bounds the in-memory queue for fd
+    void setLimit(int fd, size_t limit, OverflowPolicy policy) {
+        Queue& q = queues_[fd];
+        q.limit = limit;
+        q.policy = policy;
+    }
+
+    // Queues a copy of data for fd
+    void queue(int fd, const void* data, size_t count) {
+        if (count == 0) return;
+        Queue& q = queues_[fd];
+        if (!admit(q, data, count)) return;
+        const char* bytes = static_cast<const char*>(data);
+        if (!q.segments.empty() && !q.segments.back().external &&
+            q.segments.back().offset + q.segments.back().length == q.storage.size()) {
+            q.segments.back().length += count; // Extend the trailing copied segment
+        } else {
+            q.segments.push_back({nullptr, q.storage.size(), count, false});
+        }
+        q.storage.append(bytes, count);
+        q.pending += count;
+        noteDepth(q);
+    }
+
+    void queue(int fd, const std::string& data) {
+        queue(fd, data.data(), data.size());
+    }
+
+    // Queues caller-owned memory for fd without copying it
+    void queueRef(int fd, const void* data, size_t count) {
+        if (count == 0) return;
+        Queue& q = queues_[fd];
+        if (!admit(q, data, count)) return;
+        q.segments.push_back({static_cast<const char*>(data), 0, count, true});
+        q.pending += count;
+        noteDepth(q);
+    }
+
+    // Bytes waiting for fd, in memory and spilled
+    size_t pending(int fd) const {
+        auto it = queues_.find(fd);
+        return it == queues_.end() ? 0 : it->second.pending + it->second.spilled();
+    }
+
+    // True after a flush of fd hit EAGAIN and before one fully drained it
+    bool blocked(int fd) const {
+        auto it = queues_.find(fd);
+        return it != queues_.end() && it->second.blocked;
+    }
+
+    // Writes as much queued output for fd as it accepts without blocking
+    FlushResult flush(int fd) {
+        auto it = queues_.find(fd);
+        if (it == queues_.end()) return FlushResult::kFlushed;
+        return flushQueue(fd, it->second);
+    }
+
+    // Drops anything queued for fd, e.g. when the descriptor is closed
+    void discard(int fd) {
+        auto it = queues_.find(fd);
+        if (it == queues_.end()) return;
+        it->second.closeSpill();
+        queues_.erase(it);
+    }
+
+    uint64_t queuedWrites() const { return queued_; }
+    uint64_t writeCalls() const { return write_calls_; }
+    uint64_t blockedFlushes() const { return blocked_flushes_; }
+    uint64_t droppedBytes() const { return dropped_bytes_; }
+    uint64_t spilledBytes() const { return spilled_bytes_; }
+    size_t peakDepth() const { return peak_depth_; }
+
+private:
+    // Bytes read back from a spill file per refill
+    static constexpr size_t kSpillChunk = 64 * 1024;
+
+    struct Segment {
+        const char* data; // External memory, or nullptr for the queue's own storage
+        size_t offset;    // Offset into storage for copied segments
+        size_t length;
+        bool external;
+    };
+
+    struct Queue {
+        std::string storage;
+        std::deque<Segment> segments;
+        size_t pending = 0;       // Bytes held in memory
+        size_t consumed = 0;      // Bytes of storage already written
+        size_t owned = 0;         // Leading segments known to reference nothing
+        size_t limit = SIZE_MAX;
+        OverflowPolicy policy = OverflowPolicy::kBlock;
+        bool blocked = false;
+        int spill_fd = -1;
+        off_t spill_read = 0;     // Next spilled byte to replay
+        off_t spill_write = 0;    // End of spilled data
+
+        size_t spilled() const { return static_cast<size_t>(spill_write - spill_read); }
+
+        void reset() {
+            storage.clear();
+            segments.clear();
+            pending = consumed = owned = 0;
+        }
+
+        void closeSpill() {
+            if (spill_fd != -1) close(spill_fd);
+            spill_fd = -1;
+            spill_read = spill_write = 0;
+        }
+    };
+
+    // Applies the overflow policy; false when the data was dropped or spilled
+    bool admit(Queue& q, const void* data, size_t count) {
+        ++queued_;
+        // Once spilling starts, later output must follow the spilled bytes
+        bool over = q.pending + count > q.limit || q.spilled() > 0;
+        if (!over || q.policy == OverflowPolicy::kBlock) return true;
+        if (q.policy == OverflowPolicy::kSpill && spill(q, data, count)) return false;
+        dropped_bytes_ += count;
+        return false;
+    }
+
+    bool spill(Queue& q, const void* data, size_t count) {
+        if (q.spill_fd == -1) {
+            q.spill_fd = openSpillFile();
+            if (q.spill_fd == -1) return false;
+        }
+        const char* ptr = static_cast<const char*>(data);
+        size_t done = 0;
+        while (done < count) {
+            ssize_t written = pwrite(q.spill_fd, ptr + done, count - done, q.spill_write + done);
+            if (written == -1 && errno == EINTR) continue;
+            if (written <= 0) {
+                q.spill_write += done;
+                spilled_bytes_ += done;
+                dropped_bytes_ += count - done;
+                return true;
+            }
+            done += written;
+        }
+        q.spill_write += count;
+        spilled_bytes_ += count;
+        noteDepth(q);
+        return true;
+    }
+
+    static int openSpillFile() {
+        const char* dir = std::getenv("TMPDIR");
+        std::string path = dir && *dir ? dir : "/tmp";
+        int fd = open(path.c_str(), O_TMPFILE | O_RDWR | O_CLOEXEC, 0600);
+        if (fd != -1) return fd;
+
+        std::string name = path + "/terminal_emulator.XXXXXX";
+        fd = mkstemp(&name[0]);
+        if (fd != -1) unlink(name.c_str());
+        return fd;
+    }
+
+    // Moves the next chunk of spilled output back into memory
+    void refill(Queue& q) {
+        size_t count = std::min(q.spilled(), kSpillChunk);
+        std::string chunk(count, '\0');
+        ssize_t got = pread(q.spill_fd, &chunk[0], count, q.spill_read);
+        if (got <= 0) {
+            q.closeSpill(); // Unreadable spill data can only be abandoned
+            return;
+        }
+        q.spill_read += got;
+        if (q.spilled() == 0) {
+            // Fully replayed: reuse the file from the start
+            if (ftruncate(q.spill_fd, 0) == -1) q.closeSpill();
+            q.spill_read = q.spill_write = 0;
+        }
+        q.segments.push_back({nullptr, q.storage.size(), static_cast<size_t>(got), false});
+        q.storage.append(chunk.data(), got);
+        q.pending += got;
+    }
+
+    FlushResult flushQueue(int fd, Queue& q) {
+        while (true) {
+            if (q.pending == 0) {
+                if (q.spilled() == 0) {
+                    q.blocked = false;
+                    return FlushResult::kFlushed;
+                }
+                refill(q);
+                continue;
+            }
+
+            // At most IOV_MAX segments per pass, so a deep backlog costs a
+            // flush no more than the segments it writes
+            std::vector<struct iovec> iov;
+            size_t batch = std::min<size_t>(q.segments.size(), IOV_MAX);
+            iov.reserve(batch);
+            for (size_t i = 0; i < batch; ++i) {
+                const Segment& seg = q.segments[i];
+                const char* base = seg.external ? seg.data : q.storage.data() + seg.offset;
+                iov.push_back({const_cast<char*>(base), seg.length});
+            }
+
+            size_t first = 0;
+            while (first < iov.size()) {
+                ssize_t written = writev(fd, &iov[first], static_cast<int>(iov.size() - first));
+                ++write_calls_;
+                if (written == -1) {
+                    if (errno == EINTR) continue;
+                    if (errno == EAGAIN) {
+                        dropWritten(q, iov, first);
+                        keepRemainder(q);
+                        if (!q.blocked) ++blocked_flushes_;
+                        q.blocked = true;
+                        return FlushResult::kBlocked;
+                    }
+                    std::cerr << "Write error: " << std::strerror(errno) << std::endl;
+                    q.reset();
+                    q.closeSpill();
+                    q.blocked = false;
+                    return FlushResult::kFailed;
+                }
+                // Skip fully written vectors and trim a partially written one
+                size_t remaining = static_cast<size_t>(written);
+                while (first < iov.size() && remaining >= iov[first].iov_len) {
+                    remaining -= iov[first].iov_len;
+                    ++first;
+                }
+                if (remaining > 0) {
+                    iov[first].iov_base = static_cast<char*>(iov[first].iov_base) + remaining;
+                    iov[first].iov_len -= remaining;
+                }
+            }
+            dropWritten(q, iov, first);
+            if (q.segments.empty()) q.reset();
+        }
+    }
+
+    // Pops the segments the last writev() finished and trims a partly
+    // written one; the bytes stay in storage until it is compacted
+    static void dropWritten(Queue& q, const std::vector<struct iovec>& iov, size_t first) {
+        for (size_t i = 0; i < first; ++i) {
+            const Segment& seg = q.segments.front();
+            if (!seg.external) q.consumed += seg.length;
+            q.pending -= seg.length;
+            q.segments.pop_front();
+        }
+        q.owned = q.owned > first ? q.owned - first : 0;
+        if (first == iov.size()) return;
+        Segment& seg = q.segments.front();
+        size_t written = seg.length - iov[first].iov_len;
+        if (seg.external) {
+            seg.data += written;
+        } else {
+            seg.offset += written;
+            q.consumed += written;
+        }
+        seg.length -= written;
+        q.pending -= written;
+    }
+
+    // Copies the referenced segments queued since the last call into storage
+    // so callers may reuse their buffers; everything else stays in place, so
+    // a slow descriptor costs no copying per flush. Storage is compacted once
+    // its written bytes outweigh the bytes still queued.
+    static void keepRemainder(Queue& q) {
+        for (size_t i = q.owned; i < q.segments.size(); ++i) {
+            Segment& seg = q.segments[i];
+            if (!seg.external) continue;
+            seg.offset = q.storage.size();
+            q.storage.append(seg.data, seg.length);
+            seg.data = nullptr;
+            seg.external = false;
+        }
+        q.owned = q.segments.size();
+        if (q.consumed * 2 <= q.storage.size()) return;
+        std::string live;
+        live.reserve(q.storage.size() - q.consumed);
+        for (Segment& seg : q.segments) {
+            live.append(q.storage, seg.offset, seg.length);
+            seg.offset = live.size() - seg.length;
+        }
+        q.storage.swap(live);
+        q.consumed = 0;
+    }
+
+    void noteDepth(const Queue& q) {
+        peak_depth_ = std::max(peak_depth_, q.pending + q.spilled());
+    }
+
+    std::unordered_map<int, Queue> queues_;
+    uint64_t queued_ = 0;
+    uint64_t write_calls_ = 0;
+    uint64_t blocked_flushes_ = 0;
+    uint64_t dropped_bytes_ = 0;
+    uint64_t spilled_bytes_ = 0;
+    size_t peak_depth_ = 0;
+};
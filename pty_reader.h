@@ -0,0 +1,177 @@
+#pragma once
+
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <signal.h>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/eventfd.h>
+
+#include "spsc_ring.h"
+
+// Dedicated thread that drains a PTY master into an SpscByteRing, so the
+// kernel PTY buffer stays empty and the child keeps running while the
+// consuming thread is busy. The consumer is woken through an eventfd, but
+// only after it has announced with armWakeup() that it found the ring empty,
+// so a steady stream costs no wakeup syscalls per read.
+class PtyReader {
+public:
+    PtyReader(int fd, size_t ring_size) : fd_(fd), ring_(ring_size) {
+        notify_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        space_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        stop_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (notify_fd_ == -1 || space_fd_ == -1 || stop_fd_ == -1) {
+            int err = errno;
+            closeFds();
+            throw std::runtime_error("eventfd failed: " + std::string(std::strerror(err)));
+        }
+
+        // Keep signals on the main thread: start the reader with everything blocked
+        sigset_t all, previous;
+        sigfillset(&all);
+        pthread_sigmask(SIG_BLOCK, &all, &previous);
+        try {
+            thread_ = std::thread([this] { run(); });
+        } catch (...) {
+            pthread_sigmask(SIG_SETMASK, &previous, nullptr);
+            closeFds();
+            throw;
+        }
+        pthread_sigmask(SIG_SETMASK, &previous, nullptr);
+    }
+
+    ~PtyReader() {
+        notify(stop_fd_);
+        thread_.join();
+        closeFds();
+    }
+
+    PtyReader(const PtyReader&) = delete;
+    PtyReader& operator=(const PtyReader&) = delete;
+
+    // Readable when output arrived after armWakeup(), or when the PTY closed
+    int notifyFd() const { return notify_fd_; }
+
+    // Consumer side of the ring
+    SpscByteRing::Span readable() { return ring_.readable(); }
+
+    void release(size_t count) {
+        ring_.release(count);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (producer_waiting_.exchange(false)) notify(space_fd_);
+    }
+
+    // Clears the notification counter before the consumer drains the ring
+    void acknowledge() {
+        eventfd_t value;
+        eventfd_read(notify_fd_, &value);
+    }
+
+    // Requests a wakeup for the next output. Returns false if output raced in,
+    // in which case the caller should keep consuming instead of sleeping.
+    bool armWakeup() {
+        consumer_waiting_.store(true);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (ring_.readable().size == 0) return true;
+        consumer_waiting_.store(false);
+        return false;
+    }
+
+    // Makes notifyFd() readable, e.g. to resume consumption after a pause
+    void wake() { notify(notify_fd_); }
+
+    // True once the reader hit EOF or EIO; data may still be in the ring
+    bool closed() const { return closed_.load(std::memory_order_acquire); }
+
+    uint64_t bytesRead() const { return bytes_read_.load(std::memory_order_relaxed); }
+    uint64_t reads() const { return reads_.load(std::memory_order_relaxed); }
+    uint64_t fullStalls() const { return full_stalls_.load(std::memory_order_relaxed); }
+
+private:
+    void run() {
+        while (true) {
+            SpscByteRing::Span span = ring_.writable();
+            if (span.size == 0) {
+                if (!waitForSpace()) return;
+                continue;
+            }
+
+            ssize_t count = read(fd_, span.data, span.size);
+            if (count > 0) {
+                ring_.commit(count);
+                bytes_read_.fetch_add(count, std::memory_order_relaxed);
+                reads_.fetch_add(1, std::memory_order_relaxed);
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                if (consumer_waiting_.exchange(false)) notify(notify_fd_);
+                continue;
+            }
+            if (count == -1 && errno == EINTR) continue;
+            if (count == -1 && errno == EAGAIN) {
+                if (!waitFor(fd_)) return;
+                continue;
+            }
+
+            // EOF or EIO: the slave side is closed, so the shell has exited
+            closed_.store(true, std::memory_order_release);
+            notify(notify_fd_);
+            return;
+        }
+    }
+
+    // Sleeps until the consumer frees ring space; false when asked to stop
+    bool waitForSpace() {
+        full_stalls_.fetch_add(1, std::memory_order_relaxed);
+        producer_waiting_.store(true);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (ring_.writable().size > 0) {
+            producer_waiting_.store(false);
+            return true;
+        }
+        if (!waitFor(space_fd_)) return false;
+        eventfd_t value;
+        eventfd_read(space_fd_, &value);
+        return true;
+    }
+
+    // Waits for fd to become readable; false when asked to stop
+    bool waitFor(int fd) {
+        struct pollfd fds[2] = {
+            {fd, POLLIN, 0},
+            {stop_fd_, POLLIN, 0}
+        };
+        while (poll(fds, 2, -1) == -1) {
+            if (errno != EINTR) return false;
+        }
+        return !(fds[1].revents & POLLIN);
+    }
+
+    static void notify(int fd) {
+        eventfd_write(fd, 1);
+    }
+
+    void closeFds() {
+        if (notify_fd_ != -1) close(notify_fd_);
+        if (space_fd_ != -1) close(space_fd_);
+        if (stop_fd_ != -1) close(stop_fd_);
+    }
+
+    int fd_;
+    SpscByteRing ring_;
+    int notify_fd_ = -1;
+    int space_fd_ = -1;
+    int stop_fd_ = -1;
+    std::thread thread_;
+
+    alignas(64) std::atomic<bool> consumer_waiting_{true}; // Nothing consumed yet, so the first read wakes the consumer
+    alignas(64) std::atomic<bool> producer_waiting_{false};
+    std::atomic<bool> closed_{false};
+    std::atomic<uint64_t> bytes_read_{0};
+    std::atomic<uint64_t> reads_{0};
+    std::atomic<uint64_t> full_stalls_{0};
+};
@@ -0,0 +1,292 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "screen.h"
+
+// Presents a Screen on the host terminal by diffing it against the last frame
+// the host was sent.
+//
+// The renderer keeps its own copy of the host's cells. Each frame it replays
+// whole-screen scrolls as line feeds (so the host's own scrollback still
+// fills), then compares only the rows the grid marked dirty and writes the
+// cells that differ, with the shortest cursor moves it knows and an erase to
+// end of line for blank tails. Cells compare by style index, which includes
+// the OSC 8 hyperlink, so links are opened and closed along with SGR.
+// Sequences the host must see but the screen model does not draw (mode
+// changes, queries, titles, the bell) are queued with passthrough() and sent
+// after the frame, so replies such as cursor position reports match what was
+// drawn.
+class Renderer {
+public:
+    // Forces a full repaint from a cleared host screen
+    void invalidate() { rows_ = cols_ = 0; }
+
+    // Queues bytes to send to the host unchanged after the next frame
+    void passthrough(const char* data, size_t count) { passthrough_.append(data, count); }
+
+    // Marks the style indices the renderer holds, for a StyleTable collection
+    void markStyles(StyleTable& styles) const {
+        styles.markCells(front_.data(), front_.size());
+        styles.mark(style_);
+        styles.markLink(link_);
+    }
+
+    // Appends the bytes that bring the host up to date with screen to out
+    void render(Screen& screen, std::string& out) {
+        const Grid& grid = screen.grid();
+        // Cell updates go in a synchronized update, which hosts that support
+        // it show at once; a frame that only moves the cursor needs none
+        size_t start = out.size();
+        out += "\x1B[?2026h";
+        size_t body = out.size();
+
+        if (grid.rows() != rows_ || grid.cols() != cols_) {
+            // Size changed: the host has rewrapped its screen in its own way
+            resize(grid.rows(), grid.cols());
+            setStyle(0, nullptr, out);
+            out += "\x1B[H\x1B[2J";
+            grid_ = nullptr;
+        }
+        bool all = &grid != grid_; // After a screen switch every row may differ
+        grid_ = &grid;
+
+        if (!all && grid.scrolled() > 0) replayScroll(grid.scrolled(), out);
+        for (size_t r = 0; r < rows_; ++r) {
+            if (all || grid.dirty(r)) renderRow(screen, r, out);
+        }
+        bool drawn = out.size() != body;
+        if (!drawn) out.resize(start);
+
+        moveTo(screen.cursorRow(), screen.cursorCol(), out);
+        if (screen.cursorVisible() != cursor_visible_) {
+            cursor_visible_ = screen.cursorVisible();
+            out += cursor_visible_ ? "\x1B[?25h" : "\x1B[?25l";
+        }
+        screen.clearDamage();
+        if (drawn) out += "\x1B[?2026l";
+        out += passthrough_;
+        passthrough_.clear();
+    }
+
+private:
+    static constexpr size_t kUnknown = SIZE_MAX;
+    // Blank tails at least this long are erased with EL instead of written
+    static constexpr size_t kMinEraseRun = 4;
+    // Longest gap skipTo() fills by rewriting cells
+    static constexpr size_t kMaxRewrite = 3;
+
+    // Interned clusters compare by id: markStyles() keeps the ids front_ holds
+    // alive, so an id is never reused for other text while the host shows it
+    static bool sameCell(const Cell& a, const Cell& b) {
+        return a.codepoint == b.codepoint && a.style == b.style && a.width == b.width;
+    }
+
+    void resize(size_t rows, size_t cols) {
+        rows_ = rows;
+        cols_ = cols;
+        front_.assign(rows * cols, blankCell(0));
+        cursor_row_ = cursor_col_ = kUnknown;
+    }
+
+    // Scrolls the host the way the model scrolled: line feeds on the bottom row
+    void replayScroll(size_t n, std::string& out) {
+        n = std::min(n, rows_);
+        moveTo(rows_ - 1, 0, out);
+        setStyle(0, nullptr, out); // Rows scrolled in take the current background
+        out.append(n, '\n');
+        std::copy(front_.begin() + n * cols_, front_.end(), front_.begin());
+        std::fill(front_.end() - n * cols_, front_.end(), blankCell(0));
+    }
+
+    void renderRow(Screen& screen, size_t r, std::string& out) {
+        const Cell* model = screen.grid().row(r);
+        Cell* front = front_.data() + r * cols_;
+
+        // Start of the blank tail that can be erased in one EL
+        size_t tail = cols_;
+        const Cell& last = model[cols_ - 1];
+        if (last.codepoint == U' ' && erasable(screen.styles().get(last.style))) {
+            while (tail > 0 && sameCell(model[tail - 1], last)) --tail;
+        }
+
+        for (size_t c = 0; c < cols_;) {
+            if (sameCell(model[c], front[c])) {
+                ++c;
+                continue;
+            }
+            if (c >= tail && cols_ - c >= kMinEraseRun) {
+                moveTo(r, c, out);
+                setStyle(last.style, &screen.styles(), out);
+                out += "\x1B[K";
+                std::fill(front + c, front + cols_, last);
+                break;
+            }
+            // A changed right half is redrawn through its left half
+            if (model[c].width == 0 && c > 0 && model[c - 1].width == 2) --c;
+            const Cell& cell = model[c];
+            skipTo(model, r, c, out);
+            setStyle(cell.style, &screen.styles(), out);
+            if (StyleTable::isCluster(cell.codepoint)) {
+                for (char32_t part : screen.styles().cluster(cell.codepoint)) appendUtf8(part, out);
+            } else {
+                appendUtf8(cell.codepoint ? cell.codepoint : U' ', out);
+            }
+            size_t width = std::max<size_t>(cell.width, 1);
+            std::copy(model + c, model + std::min(c + width, cols_), front + c);
+            c += width;
+            // Writing the last column leaves the host in its pending-wrap
+            // state, which cursor motion treats differently across terminals
+            cursor_col_ = c < cols_ ? c : kUnknown;
+        }
+    }
+
+    // Moves right to c on row r. A short gap of unchanged cells in the host's
+    // current style is cheaper to write again than to skip with CUF.
+    void skipTo(const Cell* model, size_t r, size_t c, std::string& out) {
+        if (r == cursor_row_ && cursor_col_ != kUnknown && c > cursor_col_ && c - cursor_col_ <= kMaxRewrite) {
+            size_t k = cursor_col_;
+            while (k < c && model[k].width == 1 && model[k].style == style_ && model[k].codepoint < 0x80) ++k;
+            if (k == c) {
+                for (k = cursor_col_; k < c; ++k) out += static_cast<char>(model[k].codepoint);
+                cursor_col_ = c;
+                return;
+            }
+        }
+        moveTo(r, c, out);
+    }
+
+    // EL fills with the background only, so it reproduces blanks whose style
+    // has no other visible attribute
+    static bool erasable(const Style& style) {
+        return (style.flags & (Style::kInverse | Style::kStrike | Style::kOverline)) == 0 && style.underline == 0 &&
+               style.link == 0;
+    }
+
+    void moveTo(size_t r, size_t c, std::string& out) {
+        if (r == cursor_row_ && c == cursor_col_) return;
+        if (r == cursor_row_ && cursor_col_ != kUnknown) {
+            if (c == 0) {
+                out += '\r';
+            } else if (c > cursor_col_) {
+                appendCsi(c - cursor_col_, 'C', out);
+            } else {
+                appendCsi(cursor_col_ - c, 'D', out);
+            }
+        } else if (c == 0 && cursor_row_ != kUnknown && r == cursor_row_ + 1) {
+            out += "\r\n"; // Never on the bottom row, so this cannot scroll
+        } else {
+            out += "\x1B[";
+            out += std::to_string(r + 1);
+            out += ';';
+            out += std::to_string(c + 1);
+            out += 'H';
+        }
+        cursor_row_ = r;
+        cursor_col_ = c;
+    }
+
+    static void appendCsi(size_t n, char final, std::string& out) {
+        out += "\x1B[";
+        if (n != 1) out += std::to_string(n);
+        out += final;
+    }
+
+    // Switches the host's SGR state and hyperlink to style; styles is null
+    // for the default
+    void setStyle(uint16_t style, const StyleTable* styles, std::string& out) {
+        if (style == style_) return;
+        style_ = style;
+        const Style* s = styles && style != 0 ? &styles->get(style) : nullptr;
+        if (s) {
+            appendSgr(*s, out);
+        } else {
+            out += "\x1B[0m";
+        }
+        uint16_t link = s ? s->link : 0;
+        if (link != link_) {
+            link_ = link;
+            out += "\x1B]8;";
+            out += link ? styles->link(link) : ";";
+            out += "\x1B\\";
+        }
+    }
+
+    // Extended colours go in sequences of their own: hosts cap SGR at 16
+    // parameters, and three RGB colours alone take 15
+    static void appendSgr(const Style& s, std::string& out) {
+        out += "\x1B[0";
+        if (s.flags & Style::kBold) out += ";1";
+        if (s.flags & Style::kDim) out += ";2";
+        if (s.flags & Style::kItalic) out += ";3";
+        if (s.underline == 1) out += ";4";
+        else if (s.underline > 1) out += ";4:" + std::to_string(s.underline);
+        if (s.flags & Style::kBlink) out += ";5";
+        if (s.flags & Style::kInverse) out += ";7";
+        if (s.flags & Style::kHidden) out += ";8";
+        if (s.flags & Style::kStrike) out += ";9";
+        if (s.flags & Style::kOverline) out += ";53";
+        appendColor(s.fg, 30, 90, out);
+        appendColor(s.bg, 40, 100, out);
+        out += 'm';
+        appendExtendedColor(s.fg, 38, true, out);
+        appendExtendedColor(s.bg, 48, true, out);
+        appendExtendedColor(s.underline_color, 58, false, out);
+    }
+
+    // base and bright are the 8-colour SGR codes of the first 16 palette entries
+    static void appendColor(uint32_t c, unsigned base, unsigned bright, std::string& out) {
+        if (!color::isPalette(c)) return;
+        unsigned index = c & 0xFF;
+        if (index < 8) {
+            out += ';' + std::to_string(base + index);
+        } else if (index < 16) {
+            out += ';' + std::to_string(bright + index - 8);
+        }
+    }
+
+    // Sets a colour appendColor() has no code for; short_form says whether it had one
+    static void appendExtendedColor(uint32_t c, unsigned extended, bool short_form, std::string& out) {
+        if (color::isPalette(c)) {
+            unsigned index = c & 0xFF;
+            if (short_form && index < 16) return;
+            out += "\x1B[" + std::to_string(extended) + ";5;" + std::to_string(index) + 'm';
+        } else if (color::isRgb(c)) {
+            out += "\x1B[" + std::to_string(extended) + ";2;" + std::to_string(c >> 16 & 0xFF) + ';' +
+                   std::to_string(c >> 8 & 0xFF) + ';' + std::to_string(c & 0xFF) + 'm';
+        }
+    }
+
+    static void appendUtf8(char32_t c, std::string& out) {
+        if (c < 0x80) {
+            out += static_cast<char>(c);
+        } else if (c < 0x800) {
+            out += static_cast<char>(0xC0 | c >> 6);
+            out += static_cast<char>(0x80 | (c & 0x3F));
+        } else if (c < 0x10000) {
+            out += static_cast<char>(0xE0 | c >> 12);
+            out += static_cast<char>(0x80 | (c >> 6 & 0x3F));
+            out += static_cast<char>(0x80 | (c & 0x3F));
+        } else {
+            out += static_cast<char>(0xF0 | c >> 18);
+            out += static_cast<char>(0x80 | (c >> 12 & 0x3F));
+            out += static_cast<char>(0x80 | (c >> 6 & 0x3F));
+            out += static_cast<char>(0x80 | (c & 0x3F));
+        }
+    }
+
+    std::vector<Cell> front_;     // What the host shows, row-major
+    size_t rows_ = 0;
+    size_t cols_ = 0;
+    const Grid* grid_ = nullptr;  // Grid the last frame was drawn from
+    size_t cursor_row_ = kUnknown; // Host cursor, when known
+    size_t cursor_col_ = kUnknown;
+    uint16_t style_ = 0;          // Host SGR state as a style index
+    uint16_t link_ = 0;           // Host's open hyperlink
+    bool cursor_visible_ = true;
+    std::string passthrough_;
+};
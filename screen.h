@@ -0,0 +1,942 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "cell.h"
+#include "scrollback.h"
+#include "simd_scan.h"
+#include "style.h"
+#include "unicode_tables.h"
+#include "utf8_decoder.h"
+#include "vt_parser.h"
+
+// Cells of one screen buffer. Each row is a contiguous run of cells reached
+// through a row map, so scrolling rotates row indices and blanks the
+// recycled rows instead of moving cell data.
+//
+// The grid also records damage for the renderer: rows handed out for writing
+// are marked dirty, and scroll-ups of the whole grid are counted so they can
+// be replayed on the host as line feeds instead of redrawn.
+class Grid {
+public:
+    Grid(size_t rows, size_t cols) { resize(rows, cols, 0); }
+
+    size_t rows() const { return map_.size(); }
+    size_t cols() const { return cols_; }
+
+    Cell* row(size_t r) {
+        dirty_[r] = 1;
+        return cells_.data() + map_[r] * cols_;
+    }
+    const Cell* row(size_t r) const { return cells_.data() + map_[r] * cols_; }
+
+    // Whether row r may have changed since the last clearDamage()
+    bool dirty(size_t r) const { return dirty_[r] != 0; }
+    // Scroll-ups of all rows since the last clearDamage(); rows that moved
+    // keep their dirty state
+    size_t scrolled() const { return scrolled_; }
+
+    void clearDamage() {
+        std::fill(dirty_.begin(), dirty_.end(), 0);
+        scrolled_ = 0;
+    }
+
+    void fill(size_t r, size_t from, size_t to, Cell blank) {
+        fillCells(row(r) + from, to - from, blank);
+    }
+
+    // Moves rows [top, bottom] up by n, blanking the n rows uncovered at the bottom
+    void scrollUp(size_t top, size_t bottom, size_t n, Cell blank) {
+        n = std::min(n, bottom - top + 1);
+        rotateRows(top, top + n, bottom + 1);
+        if (top == 0 && bottom + 1 == rows()) {
+            scrolled_ += n;
+            std::memmove(dirty_.data(), dirty_.data() + n, rows() - n);
+        } else {
+            std::fill(dirty_.begin() + top, dirty_.begin() + bottom + 1, 1);
+        }
+        for (size_t r = bottom + 1 - n; r <= bottom; ++r) fill(r, 0, cols_, blank);
+    }
+
+    // Moves rows [top, bottom] down by n, blanking the n rows uncovered at the top
+    void scrollDown(size_t top, size_t bottom, size_t n, Cell blank) {
+        n = std::min(n, bottom - top + 1);
+        rotateRows(top, bottom + 1 - n, bottom + 1);
+        std::fill(dirty_.begin() + top, dirty_.begin() + bottom + 1, 1);
+        for (size_t r = top; r < top + n; ++r) fill(r, 0, cols_, blank);
+    }
+
+    // Resizes to rows x cols, keeping the old rows from first onwards at the top
+    void resize(size_t rows, size_t cols, size_t first) {
+        std::vector<Cell> cells(rows * cols, blankCell(0));
+        for (size_t r = 0; r < rows && first + r < map_.size(); ++r) {
+            const Cell* src = row(first + r);
+            size_t keep = std::min(cols, cols_);
+            std::copy(src, src + keep, cells.begin() + r * cols);
+            // A wide character cut in half by the new width becomes a blank
+            if (keep > 0 && cells[r * cols + keep - 1].width == 2) cells[r * cols + keep - 1] = blankCell(0);
+        }
+        assign(rows, cols, cells);
+    }
+
+    // Replaces the contents with rows x cols cells taken row-major from
+    // cells, padded with blanks; cells receives the old storage
+    void assign(size_t rows, size_t cols, std::vector<Cell>& cells) {
+        cells.resize(rows * cols, blankCell(0));
+        cells_.swap(cells);
+        cols_ = cols;
+        map_.resize(rows);
+        for (size_t r = 0; r < rows; ++r) map_[r] = static_cast<uint32_t>(r);
+        dirty_.assign(rows, 1);
+        scrolled_ = 0;
+    }
+
+private:
+    // Rotates map_[first, last) so middle becomes first. Scrolls move few
+    // rows, so the displaced ones go through a small buffer and the rest is
+    // one memmove, instead of std::rotate's element-by-element cycles.
+    void rotateRows(size_t first, size_t middle, size_t last) {
+        uint32_t* map = map_.data();
+        size_t head = middle - first;
+        size_t tail = last - middle;
+        if (head <= tail) {
+            spare_.assign(map + first, map + middle);
+            std::memmove(map + first, map + middle, tail * sizeof(uint32_t));
+            std::copy(spare_.begin(), spare_.end(), map + first + tail);
+        } else {
+            spare_.assign(map + middle, map + last);
+            std::memmove(map + first + tail, map + first, head * sizeof(uint32_t));
+            std::copy(spare_.begin(), spare_.end(), map + first);
+        }
+    }
+
+    std::vector<Cell> cells_;
+    std::vector<uint32_t> map_; // Screen row -> storage row
+    std::vector<uint32_t> spare_;
+    std::vector<uint8_t> dirty_;  // Per screen row
+    size_t scrolled_ = 0;
+    size_t cols_ = 0;
+};
+
+// In-memory model of the shell's screen, updated by the VT parser.
+//
+// Handles the cursor, scroll region, autowrap, insert mode, tab stops, the
+// alternate screen, SGR and OSC 8 hyperlinks; queries and device reports are
+// left to the host terminal, which sees the same byte stream. Rows scrolled
+// off the primary screen go to an optional Scrollback.
+//
+// Cells hold StyleTable indices. Whenever the table has doubled since the
+// last collection, the styles no longer used by either grid, the scrollback,
+// the saved cursors or the registered style roots are freed.
+class Screen : public VtHandler {
+public:
+    // scrollback_budget is the byte budget for rows scrolled off the
+    // primary screen; 0 keeps no scrollback
+    Screen(size_t rows, size_t cols, size_t scrollback_budget = 0)
+        : primary_(rows, cols), alternate_(rows, cols) {
+        if (scrollback_budget) scrollback_ = std::make_unique<Scrollback>(scrollback_budget);
+        reset();
+    }
+
+    size_t rows() const { return active_->rows(); }
+    size_t cols() const { return active_->cols(); }
+    const Grid& grid() const { return *active_; }
+    const StyleTable& styles() const { return styles_; }
+    size_t cursorRow() const { return row_; }
+    size_t cursorCol() const { return col_; }
+    bool cursorVisible() const { return cursor_visible_; }
+    bool alternateScreen() const { return active_ == &alternate_; }
+    Scrollback* scrollback() { return scrollback_.get(); }
+
+    // Registers mark to report style indices held outside the screen, such
+    // as a renderer's copy of the host; it runs during each collection
+    void setStyleRoots(std::function<void(StyleTable&)> mark) { style_roots_ = std::move(mark); }
+
+    // Forgets the active grid's damage once a renderer has presented it
+    void clearDamage() { active_->clearDamage(); }
+
+    void resize(size_t rows, size_t cols) {
+        rows = std::max<size_t>(rows, 1);
+        cols = std::max<size_t>(cols, 1);
+        bool primary = active_ == &primary_;
+        // A taller primary screen takes rows back from the scrollback in reflow()
+        bool grows = primary && rows > primary_.rows() && scrollback_ && scrollback_->size() > 0;
+        if (cols != primary_.cols() || grows) {
+            reflow(rows, cols);
+        } else {
+            // Keep the cursor row on screen when shrinking: drop rows from the top
+            size_t first = primary && row_ >= rows ? row_ + 1 - rows : 0;
+            saveRows(first);
+            primary_.resize(rows, cols, first);
+            row_ -= first;
+        }
+        // Applications redraw the alternate screen, so it is cut, not rewrapped
+        size_t first = !primary && row_ >= rows ? row_ + 1 - rows : 0;
+        alternate_.resize(rows, cols, first);
+        row_ -= first;
+        col_ = std::min(col_, cols - 1);
+        pending_wrap_ = false;
+        cluster_row_ = SIZE_MAX; // The last cluster's cell may have moved
+        top_ = 0;
+        bottom_ = rows - 1;
+        resetTabs();
+    }
+
+    // VtHandler callbacks
+
+    void print(const char* data, size_t count) {
+        if (!decoder_.pending()) {
+            size_t ascii = asciiRun(data, count);
+            printAscii(data, ascii);
+            data += ascii;
+            count -= ascii;
+            if (count == 0) return;
+        }
+        if (decoded_.size() < count + 1) decoded_.resize(count + 1);
+        size_t n = decoder_.decode(data, count, decoded_.data());
+        for (size_t i = 0; i < n; ++i) printCodepoint(decoded_[i]);
+    }
+
+    void execute(unsigned char c) {
+        cluster_row_ = SIZE_MAX; // Controls end a cluster
+        switch (c) {
+        case '\b':
+            pending_wrap_ = false;
+            if (col_ > 0) --col_;
+            break;
+        case '\t':
+            tabForward(1);
+            break;
+        case '\n':
+        case '\v':
+        case '\f':
+            pending_wrap_ = false;
+            lineFeed();
+            break;
+        case '\r':
+            pending_wrap_ = false;
+            col_ = 0;
+            break;
+        }
+    }
+
+    void escDispatch(const VtSequence& seq) {
+        cluster_row_ = SIZE_MAX;
+        if (seq.intermediate_count == 1 && seq.intermediates[0] == '#' && seq.final == '8') {
+            alignmentPattern();
+            return;
+        }
+        if (seq.intermediate_count != 0) return; // Character set designations
+        switch (seq.final) {
+        case 'D': // IND
+            pending_wrap_ = false;
+            lineFeed();
+            break;
+        case 'E': // NEL
+            pending_wrap_ = false;
+            col_ = 0;
+            lineFeed();
+            break;
+        case 'M': // RI
+            pending_wrap_ = false;
+            reverseIndex();
+            break;
+        case 'H': // HTS
+            tabs_[col_] = true;
+            break;
+        case '7': // DECSC
+            saveCursor();
+            break;
+        case '8': // DECRC
+            restoreCursor();
+            break;
+        case 'c': // RIS
+            reset();
+            break;
+        }
+    }
+
+    void csiDispatch(const VtSequence& seq) {
+        // Sequences that may scroll or erase under the cursor end a cluster;
+        // SGR between a base and its marks does not
+        if (seq.final != 'm') cluster_row_ = SIZE_MAX;
+        if (seq.intermediate_count == 0) {
+            csiStandard(seq);
+        } else if (seq.hasIntermediates("?")) {
+            if (seq.final == 'h' || seq.final == 'l') {
+                for (size_t i = 0; i < seq.param_count; ++i) setPrivateMode(seq.params[i], seq.final == 'h');
+            }
+        } else if (seq.hasIntermediates("!") && seq.final == 'p') {
+            softReset();
+        }
+    }
+
+    void oscDispatch(const char* data, size_t count) {
+        // OSC 8 ; params ; uri starts a hyperlink and an empty uri ends it
+        if (count < 2 || data[0] != '8' || data[1] != ';') return;
+        const char* separator = static_cast<const char*>(std::memchr(data + 2, ';', count - 2));
+        if (!separator) return;
+        Style pen = pen_;
+        pen.link = separator + 1 == data + count ? 0 : styles_.internLink(std::string(data + 2, count - 2));
+        if (pen != pen_) setPen(pen);
+    }
+
+private:
+    static constexpr size_t kMinCollect = 1024;
+
+    // Where the last grapheme cluster stands in the rules that can join
+    // the next codepoint to it
+    enum class ClusterState : uint8_t {
+        kNone,
+        kPictographic,    // Extended_Pictographic Extend*
+        kPictographicZwj, // ... ZWJ: a pictograph joins
+        kRegional,        // One regional indicator: a second one joins
+    };
+
+    struct SavedCursor {
+        size_t row = 0;
+        size_t col = 0;
+        Style pen;
+        bool origin = false;
+        bool pending_wrap = false;
+    };
+
+    void reset() {
+        active_ = &primary_;
+        primary_.resize(rows(), cols(), rows());
+        alternate_.resize(rows(), cols(), rows());
+        row_ = col_ = 0;
+        cluster_row_ = SIZE_MAX;
+        cursor_visible_ = true;
+        softReset();
+        resetTabs();
+        saved_ = SavedCursor();
+        primary_saved_ = SavedCursor();
+    }
+
+    // DECSTR: modes and pen back to defaults, screen contents kept
+    void softReset() {
+        pending_wrap_ = false;
+        autowrap_ = true;
+        origin_ = false;
+        insert_ = false;
+        top_ = 0;
+        bottom_ = rows() - 1;
+        setPen(Style{});
+    }
+
+    void resetTabs() {
+        tabs_.assign(cols(), false);
+        for (size_t c = 8; c < tabs_.size(); c += 8) tabs_[c] = true;
+    }
+
+    void setPen(const Style& pen) {
+        pen_ = pen;
+        if (styles_.size() >= collect_at_) collectStyles();
+        style_ = styles_.intern(pen_);
+        // Erased cells take the current background only (xterm's BCE)
+        if (pen_.bg != blank_bg_) {
+            Style erase;
+            erase.bg = pen_.bg;
+            blank_ = blankCell(styles_.intern(erase));
+            blank_bg_ = pen_.bg;
+        }
+    }
+
+    // Frees the styles nothing refers to any more. The next collection waits
+    // until the table doubles, so the marking cost is spread over the styles
+    // interned in between.
+    void collectStyles() {
+        styles_.beginCollection();
+        for (const Grid* grid : {&primary_, &alternate_}) {
+            for (size_t r = 0; r < grid->rows(); ++r) styles_.markCells(grid->row(r), grid->cols());
+        }
+        styles_.mark(style_);
+        styles_.mark(blank_.style);
+        // Links held by pens not interned yet
+        for (const Style* pen : {&pen_, &saved_.pen, &primary_saved_.pen}) styles_.markLink(pen->link);
+        if (scrollback_) scrollback_->markStyles(styles_);
+        if (style_roots_) style_roots_(styles_);
+        styles_.sweep();
+        collect_at_ = std::min(std::max(kMinCollect, 2 * styles_.size()), StyleTable::kMaxStyles);
+        cluster_collect_at_ = std::min(std::max(kMinCollect, 2 * styles_.clusters()), StyleTable::kMaxClusters);
+    }
+
+    // Printable ASCII goes straight into the row, a row segment at a time
+    void printAscii(const char* data, size_t count) {
+        if (count == 0) return;
+        cluster_ = ClusterState::kNone;
+        while (count > 0) {
+            if (pending_wrap_) wrapLine();
+            size_t k = std::min(count, cols() - col_);
+            if (insert_) insertCells(k);
+            Cell* row = active_->row(row_);
+            splitWide(row, col_, col_ + k);
+            for (size_t i = 0; i < k; ++i) {
+                row[col_ + i] = Cell{static_cast<unsigned char>(data[i]), style_, 1, 0};
+            }
+            cluster_cell_ = col_ + k - 1;
+            data += k;
+            count -= k;
+            advance(k);
+        }
+        cluster_row_ = row_;
+        cluster_col_ = col_;
+        cluster_wrap_ = pending_wrap_;
+    }
+
+    void printCodepoint(char32_t c) {
+        // Zero-width codepoints have no cell of their own either
+        if (extendsCluster(c) || unicode::width(c) == 0) {
+            appendToCluster(c);
+            return;
+        }
+        int width = unicode::width(c);
+        if (pending_wrap_) wrapLine();
+        if (width == 2 && col_ + 1 >= cols()) {
+            if (!autowrap_ || cols() < 2) {
+                cluster_row_ = SIZE_MAX; // Nothing joins a dropped character
+                return;
+            }
+            Cell* row = active_->row(row_);
+            splitWide(row, col_, col_ + 1);
+            row[col_] = blank_;
+            row[col_].flags |= Cell::kWidePad;
+            wrapLine();
+        }
+        if (insert_) insertCells(width);
+        Cell* row = active_->row(row_);
+        splitWide(row, col_, col_ + width);
+        row[col_] = Cell{c, style_, static_cast<uint8_t>(width), 0};
+        if (width == 2) row[col_ + 1] = Cell{0, style_, 0, 0};
+        cluster_cell_ = col_;
+        advance(width);
+        cluster_row_ = row_;
+        cluster_col_ = col_;
+        cluster_wrap_ = pending_wrap_;
+    }
+
+    // Whether c continues the grapheme cluster printed last, updating the
+    // cluster state. Emoji sequences (ZWJ joins, modifiers, flag pairs) take
+    // the one wide cell hosts draw them in; spacing marks still get their
+    // own cell, as with wcwidth-based hosts.
+    bool extendsCluster(char32_t c) {
+        using unicode::GraphemeBreak;
+        GraphemeBreak property = unicode::graphemeBreak(c);
+        bool joinable = row_ == cluster_row_ && col_ == cluster_col_ && pending_wrap_ == cluster_wrap_;
+        ClusterState state = joinable ? cluster_ : ClusterState::kNone;
+        switch (property) {
+        case GraphemeBreak::kExtend:
+            cluster_ = state == ClusterState::kPictographic ? state : ClusterState::kNone;
+            return true;
+        case GraphemeBreak::kZWJ:
+            cluster_ = state == ClusterState::kPictographic ? ClusterState::kPictographicZwj : ClusterState::kNone;
+            return true;
+        case GraphemeBreak::kExtendedPictographic:
+            cluster_ = ClusterState::kPictographic;
+            return state == ClusterState::kPictographicZwj;
+        case GraphemeBreak::kRegionalIndicator:
+            cluster_ = state == ClusterState::kRegional ? ClusterState::kNone : ClusterState::kRegional;
+            return state == ClusterState::kRegional;
+        default:
+            cluster_ = ClusterState::kNone;
+            return false;
+        }
+    }
+
+    // Adds c to the cell printed last, if the cursor has not moved since;
+    // the cell then names an interned cluster. Without a cell to join, or
+    // with the cluster table full, c is dropped.
+    void appendToCluster(char32_t c) {
+        if (c < 0xA0) return; // Controls are not drawn
+        if (row_ != cluster_row_ || col_ != cluster_col_ || pending_wrap_ != cluster_wrap_) return;
+        if (styles_.clusters() >= cluster_collect_at_) collectStyles();
+        Cell& cell = active_->row(row_)[cluster_cell_];
+        if (cell.width == 0) return; // Overwritten by a wide character's right half
+        cluster_text_.clear();
+        if (StyleTable::isCluster(cell.codepoint)) {
+            cluster_text_ = styles_.cluster(cell.codepoint);
+        } else {
+            cluster_text_ += cell.codepoint;
+        }
+        cluster_text_ += c;
+        if (char32_t id = styles_.internCluster(cluster_text_)) cell.codepoint = id;
+    }
+
+    // Blanks the halves of wide characters that overwriting [from, to) would orphan
+    void splitWide(Cell* row, size_t from, size_t to) {
+        if (from > 0 && row[from].width == 0) row[from - 1] = blank_;
+        if (to < cols() && row[to].width == 0) row[to] = blank_;
+    }
+
+    void advance(size_t count) {
+        col_ += count;
+        if (col_ >= cols()) {
+            col_ = cols() - 1;
+            pending_wrap_ = autowrap_; // Without autowrap the last column is overwritten
+        }
+    }
+
+    void wrapLine() {
+        active_->row(row_)[cols() - 1].flags |= Cell::kWrapped;
+        pending_wrap_ = false;
+        col_ = 0;
+        lineFeed();
+    }
+
+    void lineFeed() {
+        if (row_ == bottom_) {
+            scrollRegionUp(1);
+        } else if (row_ + 1 < rows()) {
+            ++row_;
+        }
+    }
+
+    // Scrolls the region up by n. Rows leaving the top of the primary screen
+    // go to the scrollback; those leaving a partial region are lost as on a VT.
+    void scrollRegionUp(size_t n) {
+        if (top_ == 0 && active_ == &primary_) saveRows(std::min(n, bottom_ + 1));
+        active_->scrollUp(top_, bottom_, n, blank_);
+    }
+
+    // Rewraps the logical lines of the primary screen to cols and keeps the
+    // cursor, if the primary screen is active, on the cell it was on. Rows
+    // that no longer fit above it go to the scrollback, and rows the screen
+    // gained take the newest lines back from it. The scrollback rewraps only
+    // the lines it hands back, so the work is bounded by the screen size. A
+    // line continuing from the scrollback is rewrapped from the top row down.
+    void reflow(size_t rows, size_t cols) {
+        bool active = active_ == &primary_;
+        size_t old_rows = primary_.rows();
+        size_t old_cols = primary_.cols();
+        std::vector<Cell> line;
+        std::vector<Cell> out;
+        size_t cursor_row = 0;
+        size_t cursor_col = 0;
+        size_t used = 0; // Rows up to the last line with content or the cursor
+        for (size_t r = 0; r < old_rows;) {
+            size_t start = r;
+            line.clear();
+            bool wrapped;
+            do {
+                const Cell* cells = primary_.row(r++);
+                wrapped = (cells[old_cols - 1].flags & Cell::kWrapped) != 0;
+                line.insert(line.end(), cells, cells + old_cols);
+            } while (wrapped && r < old_rows);
+            // Trailing default blanks are padding, not part of the line
+            size_t length = line.size();
+            while (length > 0 && line[length - 1].codepoint == U' ' && line[length - 1].style == 0 &&
+                   !(line[length - 1].flags & Cell::kWrapped)) {
+                --length;
+            }
+
+            size_t mark = SIZE_MAX;
+            if (active && row_ >= start && row_ < r) mark = (row_ - start) * old_cols + col_;
+            size_t top = out.size() / cols;
+            size_t mark_row = 0;
+            size_t mark_col = 0;
+            rewrapLine(line.data(), length, cols, out, mark, &mark_row, &mark_col);
+            if (mark != SIZE_MAX) {
+                cursor_row = top + mark_row;
+                cursor_col = mark_col;
+            }
+            if (length > 0 || mark != SIZE_MAX) used = out.size() / cols;
+        }
+        size_t first = used > rows ? used - rows : 0;
+        if (active) first = std::min(first, cursor_row);
+        if (active && scrollback_ && first == 0 && rows > old_rows) {
+            size_t free = std::min(rows - old_rows, rows - std::min(used, rows));
+            size_t pulled = 0;
+            while (size_t height = scrollback_->popLine(cols, free - pulled, out)) pulled += height;
+            cursor_row += pulled;
+        }
+        if (scrollback_) {
+            for (size_t r = 0; r < first; ++r) scrollback_->push(out.data() + r * cols, cols);
+        }
+        out.erase(out.begin(), out.begin() + std::min(first * cols, out.size()));
+        out.resize(std::min(out.size(), rows * cols));
+        primary_.assign(rows, cols, out);
+        if (active) {
+            row_ = cursor_row - first;
+            col_ = cursor_col;
+        }
+    }
+
+    // Copies the top count rows of the primary screen to the scrollback
+    void saveRows(size_t count) {
+        if (!scrollback_) return;
+        for (size_t r = 0; r < count; ++r) scrollback_->push(primary_.row(r), primary_.cols());
+    }
+
+    void reverseIndex() {
+        if (row_ == top_) {
+            active_->scrollDown(top_, bottom_, 1, blank_);
+        } else if (row_ > 0) {
+            --row_;
+        }
+    }
+
+    void tabForward(unsigned n) {
+        pending_wrap_ = false;
+        while (n-- > 0 && col_ + 1 < cols()) {
+            do {
+                ++col_;
+            } while (col_ + 1 < cols() && !tabs_[col_]);
+        }
+    }
+
+    void tabBackward(unsigned n) {
+        pending_wrap_ = false;
+        while (n-- > 0 && col_ > 0) {
+            do {
+                --col_;
+            } while (col_ > 0 && !tabs_[col_]);
+        }
+    }
+
+    // Moves to a 1-based position, relative to the scroll region in origin mode
+    void moveTo(unsigned row, unsigned col) {
+        size_t base = origin_ ? top_ : 0;
+        size_t limit = origin_ ? bottom_ : rows() - 1;
+        row_ = std::min<size_t>(base + row - 1, limit);
+        col_ = std::min<size_t>(col - 1, cols() - 1);
+        pending_wrap_ = false;
+    }
+
+    void moveUp(unsigned n) {
+        size_t limit = row_ >= top_ ? top_ : 0;
+        row_ = row_ - std::min<size_t>(n, row_ - limit);
+        pending_wrap_ = false;
+    }
+
+    void moveDown(unsigned n) {
+        size_t limit = row_ <= bottom_ ? bottom_ : rows() - 1;
+        row_ = row_ + std::min<size_t>(n, limit - row_);
+        pending_wrap_ = false;
+    }
+
+    void moveRight(unsigned n) {
+        col_ = std::min<size_t>(col_ + n, cols() - 1);
+        pending_wrap_ = false;
+    }
+
+    void moveLeft(unsigned n) {
+        col_ -= std::min<size_t>(n, col_);
+        pending_wrap_ = false;
+    }
+
+    // ICH: shifts the rest of the row right by n
+    void insertCells(size_t n) {
+        Cell* row = active_->row(row_);
+        n = std::min(n, cols() - col_);
+        if (col_ > 0 && row[col_].width == 0) row[col_ - 1] = row[col_] = blank_; // Pair split by the shift
+        std::copy_backward(row + col_, row + cols() - n, row + cols());
+        fillCells(row + col_, n, blank_);
+        if (row[cols() - 1].width == 2) row[cols() - 1] = blank_; // Shifted half off the edge
+    }
+
+    // DCH: shifts the rest of the row left by n
+    void deleteCells(size_t n) {
+        Cell* row = active_->row(row_);
+        n = std::min(n, cols() - col_);
+        splitWide(row, col_, col_ + n);
+        std::copy(row + col_ + n, row + cols(), row + col_);
+        fillCells(row + cols() - n, n, blank_);
+    }
+
+    void eraseInDisplay(unsigned mode) {
+        switch (mode) {
+        case 0:
+            eraseInLine(0);
+            for (size_t r = row_ + 1; r < rows(); ++r) active_->fill(r, 0, cols(), blank_);
+            break;
+        case 1:
+            eraseInLine(1);
+            for (size_t r = 0; r < row_; ++r) active_->fill(r, 0, cols(), blank_);
+            break;
+        case 2:
+            for (size_t r = 0; r < rows(); ++r) active_->fill(r, 0, cols(), blank_);
+            break;
+        case 3: // Erase saved lines
+            if (scrollback_) scrollback_->clear();
+            break;
+        }
+    }
+
+    void eraseInLine(unsigned mode) {
+        pending_wrap_ = false;
+        switch (mode) {
+        case 0:
+            eraseCells(col_, cols());
+            break;
+        case 1:
+            eraseCells(0, col_ + 1);
+            break;
+        case 2:
+            eraseCells(0, cols());
+            break;
+        }
+    }
+
+    // Blanks [from, to) of the cursor row, with any wide character it cuts
+    void eraseCells(size_t from, size_t to) {
+        Cell* row = active_->row(row_);
+        splitWide(row, from, to);
+        fillCells(row + from, to - from, blank_);
+    }
+
+    void setScrollRegion(unsigned top, unsigned bottom) {
+        size_t t = top - 1;
+        size_t b = std::min<size_t>(bottom, rows()) - 1;
+        if (t >= b) return;
+        top_ = t;
+        bottom_ = b;
+        moveTo(1, 1);
+    }
+
+    void saveCursor() {
+        saved_ = SavedCursor{row_, col_, pen_, origin_, pending_wrap_};
+    }
+
+    void restoreCursor() {
+        row_ = std::min(saved_.row, rows() - 1);
+        col_ = std::min(saved_.col, cols() - 1);
+        origin_ = saved_.origin;
+        pending_wrap_ = saved_.pending_wrap;
+        setPen(saved_.pen);
+    }
+
+    void setPrivateMode(unsigned mode, bool set) {
+        switch (mode) {
+        case 6: // DECOM
+            origin_ = set;
+            moveTo(1, 1);
+            break;
+        case 7: // DECAWM
+            autowrap_ = set;
+            if (!set) pending_wrap_ = false;
+            break;
+        case 25: // DECTCEM
+            cursor_visible_ = set;
+            break;
+        case 47:
+        case 1047:
+        case 1049:
+            switchScreen(set, mode == 1049);
+            break;
+        }
+    }
+
+    void switchScreen(bool alternate, bool save_cursor) {
+        if (alternate == (active_ == &alternate_)) return;
+        if (alternate) {
+            if (save_cursor) {
+                saveCursor();
+                primary_saved_ = saved_;
+            }
+            active_ = &alternate_;
+            for (size_t r = 0; r < rows(); ++r) active_->fill(r, 0, cols(), blank_);
+        } else {
+            active_ = &primary_;
+            if (save_cursor) {
+                saved_ = primary_saved_;
+                restoreCursor();
+            }
+        }
+        pending_wrap_ = false;
+        cluster_row_ = SIZE_MAX;
+    }
+
+    void alignmentPattern() {
+        for (size_t r = 0; r < rows(); ++r) active_->fill(r, 0, cols(), Cell{U'E', 0, 1, 0});
+        top_ = 0;
+        bottom_ = rows() - 1;
+        moveTo(1, 1);
+    }
+
+    void csiStandard(const VtSequence& seq) {
+        unsigned n = seq.param(0, 1);
+        switch (seq.final) {
+        case '@': insertCells(n); break;
+        case 'A': moveUp(n); break;
+        case 'B': case 'e': moveDown(n); break;
+        case 'C': case 'a': moveRight(n); break;
+        case 'D': moveLeft(n); break;
+        case 'E': moveDown(n); col_ = 0; break;
+        case 'F': moveUp(n); col_ = 0; break;
+        case 'G': case '`': moveTo(static_cast<unsigned>(row_ - (origin_ ? top_ : 0) + 1), n); break;
+        case 'H': case 'f': moveTo(seq.param(0, 1), seq.param(1, 1)); break;
+        case 'I': tabForward(n); break;
+        case 'J': eraseInDisplay(seq.param(0, 0)); break;
+        case 'K': eraseInLine(seq.param(0, 0)); break;
+        case 'L':
+            if (row_ >= top_ && row_ <= bottom_) active_->scrollDown(row_, bottom_, n, blank_);
+            col_ = 0;
+            pending_wrap_ = false;
+            break;
+        case 'M':
+            if (row_ >= top_ && row_ <= bottom_) active_->scrollUp(row_, bottom_, n, blank_);
+            col_ = 0;
+            pending_wrap_ = false;
+            break;
+        case 'P': deleteCells(n); pending_wrap_ = false; break;
+        case 'S': scrollRegionUp(n); break;
+        case 'T': active_->scrollDown(top_, bottom_, n, blank_); break;
+        case 'X': eraseCells(col_, std::min<size_t>(col_ + n, cols())); pending_wrap_ = false; break;
+        case 'Z': tabBackward(n); break;
+        case 'b': repeatLast(n); break;
+        case 'd': moveTo(n, static_cast<unsigned>(col_ + 1)); break;
+        case 'g':
+            if (seq.param(0, 0) == 0) tabs_[col_] = false;
+            else if (seq.param(0, 0) == 3) std::fill(tabs_.begin(), tabs_.end(), false);
+            break;
+        case 'h': case 'l':
+            for (size_t i = 0; i < seq.param_count; ++i) {
+                if (seq.params[i] == 4) insert_ = seq.final == 'h'; // IRM
+            }
+            break;
+        case 'm': selectGraphicRendition(seq); break;
+        case 'r': setScrollRegion(seq.param(0, 1), seq.param(1, static_cast<unsigned>(rows()))); break;
+        case 's': saveCursor(); break;
+        case 'u': restoreCursor(); break;
+        }
+    }
+
+    // REP: repeats the character before the cursor
+    void repeatLast(unsigned n) {
+        if (col_ == 0 && !pending_wrap_) return;
+        const Cell* row = active_->row(row_);
+        size_t last = pending_wrap_ ? col_ : col_ - 1;
+        if (row[last].width == 0 && last > 0) --last;
+        char32_t c = row[last].codepoint;
+        n = std::min<unsigned>(n, static_cast<unsigned>(rows() * cols()));
+        if (StyleTable::isCluster(c)) {
+            std::u32string cluster = styles_.cluster(c); // Printing may collect it
+            while (n-- > 0) {
+                for (char32_t part : cluster) printCodepoint(part);
+            }
+            return;
+        }
+        while (n-- > 0) printCodepoint(c);
+    }
+
+    void selectGraphicRendition(const VtSequence& seq) {
+        Style pen = pen_;
+        if (seq.param_count == 0) pen = Style{};
+        for (size_t i = 0; i < seq.param_count; ++i) {
+            unsigned p = seq.params[i];
+            switch (p) {
+            case 0: pen = Style{}; break;
+            case 1: pen.flags |= Style::kBold; break;
+            case 2: pen.flags |= Style::kDim; break;
+            case 3: pen.flags |= Style::kItalic; break;
+            case 4:
+                if (isSubparam(seq, i + 1)) {
+                    pen.underline = static_cast<uint8_t>(std::min<unsigned>(seq.params[++i], 5));
+                } else {
+                    pen.underline = 1;
+                }
+                break;
+            case 5: case 6: pen.flags |= Style::kBlink; break;
+            case 7: pen.flags |= Style::kInverse; break;
+            case 8: pen.flags |= Style::kHidden; break;
+            case 9: pen.flags |= Style::kStrike; break;
+            case 21: pen.underline = 2; break;
+            case 22: pen.flags &= ~(Style::kBold | Style::kDim); break;
+            case 23: pen.flags &= ~Style::kItalic; break;
+            case 24: pen.underline = 0; break;
+            case 25: pen.flags &= ~Style::kBlink; break;
+            case 27: pen.flags &= ~Style::kInverse; break;
+            case 28: pen.flags &= ~Style::kHidden; break;
+            case 29: pen.flags &= ~Style::kStrike; break;
+            case 38: i = extendedColor(seq, i, pen.fg); break;
+            case 39: pen.fg = color::kDefault; break;
+            case 48: i = extendedColor(seq, i, pen.bg); break;
+            case 49: pen.bg = color::kDefault; break;
+            case 53: pen.flags |= Style::kOverline; break;
+            case 55: pen.flags &= ~Style::kOverline; break;
+            case 58: i = extendedColor(seq, i, pen.underline_color); break;
+            case 59: pen.underline_color = color::kDefault; break;
+            default:
+                if (p >= 30 && p <= 37) pen.fg = color::palette(p - 30);
+                else if (p >= 40 && p <= 47) pen.bg = color::palette(p - 40);
+                else if (p >= 90 && p <= 97) pen.fg = color::palette(p - 90 + 8);
+                else if (p >= 100 && p <= 107) pen.bg = color::palette(p - 100 + 8);
+                break;
+            }
+        }
+        pen.link = pen_.link; // Hyperlinks are not SGR state
+        if (pen != pen_) setPen(pen);
+    }
+
+    static bool isSubparam(const VtSequence& seq, size_t i) {
+        return i < seq.param_count && (seq.subparams >> i & 1);
+    }
+
+    // Parses 38/48/58 in both the ';' form (38;5;n, 38;2;r;g;b) and the ':'
+    // form (38:5:n, 38:2:r:g:b, 38:2:id:r:g:b); returns the last index used
+    static size_t extendedColor(const VtSequence& seq, size_t i, uint32_t& target) {
+        if (isSubparam(seq, i + 1)) {
+            size_t count = 0;
+            while (isSubparam(seq, i + 1 + count)) ++count;
+            const uint16_t* sub = seq.params + i + 1;
+            if (sub[0] == 5 && count >= 2) {
+                target = color::palette(sub[1]);
+            } else if (sub[0] == 2 && count >= 4) {
+                size_t first = count >= 5 ? 2 : 1; // Skip the optional colour space id
+                target = color::rgb(sub[first], sub[first + 1], sub[first + 2]);
+            }
+            return i + count;
+        }
+        if (i + 2 < seq.param_count && seq.params[i + 1] == 5) {
+            target = color::palette(seq.params[i + 2]);
+            return i + 2;
+        }
+        if (i + 4 < seq.param_count && seq.params[i + 1] == 2) {
+            target = color::rgb(seq.params[i + 2], seq.params[i + 3], seq.params[i + 4]);
+            return i + 4;
+        }
+        return seq.param_count; // Malformed: ignore the rest
+    }
+
+    Grid primary_;
+    Grid alternate_;
+    Grid* active_ = &primary_;
+    std::unique_ptr<Scrollback> scrollback_;
+    StyleTable styles_;
+    size_t collect_at_ = kMinCollect; // Table size that triggers collectStyles()
+    size_t cluster_collect_at_ = kMinCollect; // Likewise for the cluster count
+    std::function<void(StyleTable&)> style_roots_;
+    Utf8Decoder decoder_;
+    std::vector<char32_t> decoded_; // Scratch space for decoded print runs
+
+    size_t row_ = 0;
+    size_t col_ = 0;
+    bool pending_wrap_ = false;     // Cursor sits past the last column until the next print
+    ClusterState cluster_ = ClusterState::kNone;
+    size_t cluster_row_ = SIZE_MAX; // Cursor after the last cluster, which only joins from there
+    size_t cluster_col_ = SIZE_MAX;
+    bool cluster_wrap_ = false;
+    size_t cluster_cell_ = SIZE_MAX; // Column of the last cluster's cell
+    std::u32string cluster_text_;   // Scratch for appendToCluster()
+    bool autowrap_ = true;
+    bool origin_ = false;
+    bool insert_ = false;
+    bool cursor_visible_ = true;
+    size_t top_ = 0;                // Scroll region, inclusive
+    size_t bottom_ = 0;
+    std::vector<bool> tabs_;
+    Style pen_;                     // Current SGR state
+    uint16_t style_ = 0;            // pen_ interned
+    Cell blank_ = blankCell(0);     // Cell used for erasing, with the pen's background
+    uint32_t blank_bg_ = color::kDefault; // Background blank_ was built for
+    SavedCursor saved_;
+    SavedCursor primary_saved_;     // DECSC state of the primary screen while 1049 is active
+};
@@ -0,0 +1,388 @@
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <signal.h>
+#include <thread>
+#include <pthread.h>
+#include <vector>
+
+#include "cell.h"
+#include "lz_codec.h"
+#include "style.h"
+
+// Rows scrolled off the top of the primary screen, kept within a fixed byte
+// budget so a session left open for weeks uses no more memory than on day one.
+//
+// Rows are appended to pages of kRowsPerPage rows; trailing blanks are not
+// stored. Once a page falls behind the kHotPages newest ones, a background
+// thread compresses it with the LZ codec, after splitting the cells into
+// byte planes so the mostly-zero high bytes of codepoints and styles collapse
+// into long matches. When the total exceeds the budget the oldest pages are
+// dropped whole. Reading a compressed row unpacks its page into a one-page
+// cache, so scrolling through history decompresses each page once. Each
+// sealed page also lists the distinct styles and clusters of its cells, so
+// a StyleTable collection can keep them without unpacking anything.
+//
+// Rows keep the width they were written at, with a bit per row saying
+// whether it soft-wraps, so resizing the window does no work on history.
+// popLine() rewraps a logical line to the new width only when a screen that
+// grew taller takes it back.
+class Scrollback {
+public:
+    static constexpr size_t kRowsPerPage = 128;
+    static constexpr size_t kHotPages = 2; // Sealed pages left uncompressed for quick access
+
+    explicit Scrollback(size_t budget) : budget_(budget) {
+        // The compressor never handles signals: start it with everything blocked
+        sigset_t all, previous;
+        sigfillset(&all);
+        pthread_sigmask(SIG_BLOCK, &all, &previous);
+        try {
+            thread_ = std::thread([this] { run(); });
+        } catch (...) {
+            pthread_sigmask(SIG_SETMASK, &previous, nullptr);
+            throw;
+        }
+        pthread_sigmask(SIG_SETMASK, &previous, nullptr);
+    }
+
+    ~Scrollback() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        wake_.notify_one();
+        thread_.join();
+    }
+
+    Scrollback(const Scrollback&) = delete;
+    Scrollback& operator=(const Scrollback&) = delete;
+
+    // Rows currently held, oldest first
+    size_t size() const { return rows_; }
+
+    // Bytes of cell storage held, including the page being filled and the read cache
+    size_t bytes() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return bytes_ + openBytes() + cache_cells_.capacity() * sizeof(Cell);
+    }
+
+    uint64_t droppedRows() const { return dropped_rows_; }
+
+    size_t compressedPages() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return compressed_pages_;
+    }
+
+    // Appends a row of count cells
+    void push(const Cell* cells, size_t count) {
+        count = trimmedLength(cells, count);
+        if (!open_) open_ = std::make_shared<Page>();
+        open_->cells.insert(open_->cells.end(), cells, cells + count);
+        if (count > 0 && (cells[count - 1].flags & Cell::kWrapped)) {
+            size_t r = open_->ends.size();
+            open_->wrapped[r / 64] |= uint64_t{1} << (r % 64);
+        }
+        open_->ends.push_back(static_cast<uint32_t>(open_->cells.size()));
+        ++rows_;
+        if (open_->ends.size() == kRowsPerPage) seal();
+    }
+
+    // Copies row index (0 is the oldest) into out, without the trimmed
+    // trailing blanks. Returns false if index is out of range.
+    bool row(size_t index, std::vector<Cell>& out) {
+        if (index >= rows_) return false;
+        size_t page_index = index / kRowsPerPage;
+        size_t r = index % kRowsPerPage;
+        if (page_index == pages_.size()) return copyRow(*open_, open_->cells.data(), r, out);
+
+        const std::shared_ptr<Page>& page = pages_[page_index];
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (!page->compressed) return copyRow(*page, page->cells.data(), r, out);
+        }
+        // Compressed data is never modified again, so it is read unlocked
+        if (cache_page_ != page) {
+            if (!unpack(*page, cache_cells_)) {
+                out.clear();
+                return true;
+            }
+            cache_page_ = page;
+        }
+        return copyRow(*page, cache_cells_.data(), r, out);
+    }
+
+    // Removes the newest logical line and prepends it to out rewrapped to
+    // cols, unless it takes more than max_rows rows or continues onto the
+    // screen. Returns the rows prepended.
+    size_t popLine(size_t cols, size_t max_rows, std::vector<Cell>& out) {
+        if (cols == 0 || max_rows == 0 || rows_ == 0 || wrapped(rows_ - 1)) return 0;
+        size_t first = rows_ - 1;
+        while (first > 0 && wrapped(first - 1)) --first;
+        reflow_source_.clear();
+        for (size_t r = first; r < rows_; ++r) {
+            row(r, reflow_row_);
+            reflow_source_.insert(reflow_source_.end(), reflow_row_.begin(), reflow_row_.end());
+        }
+        reflow_cells_.clear();
+        size_t height = rewrapLine(reflow_source_.data(), reflow_source_.size(), cols, reflow_cells_);
+        if (height > max_rows) return 0;
+        out.insert(out.begin(), reflow_cells_.begin(), reflow_cells_.end());
+        pop(rows_ - first);
+        return height;
+    }
+
+    // Marks the style and clusters of every row held, for a StyleTable collection
+    void markStyles(StyleTable& styles) const {
+        for (const auto& page : pages_) {
+            for (uint16_t id : page->styles) styles.mark(id);
+            for (char32_t c : page->clusters) styles.markCluster(c);
+        }
+        if (open_) styles.markCells(open_->cells.data(), open_->cells.size());
+    }
+
+    // Drops every row (ED 3)
+    void clear() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (auto& page : pages_) page->dropped = true;
+        pages_.clear();
+        jobs_.clear();
+        open_.reset();
+        cache_page_.reset();
+        std::vector<Cell>().swap(cache_cells_);
+        bytes_ = 0;
+        compressed_pages_ = 0;
+        rows_ = 0;
+    }
+
+private:
+    struct Page {
+        std::vector<Cell> cells;     // Rows back to back; released once compressed
+        std::vector<uint32_t> ends;  // End of each row in cells
+        std::vector<uint8_t> packed; // Compressed byte planes of cells
+        std::vector<uint16_t> styles; // Distinct styles of cells
+        std::vector<char32_t> clusters; // Cluster codepoints of cells
+        uint64_t wrapped[kRowsPerPage / 64] = {}; // Rows that soft-wrap onto the next
+        size_t cell_count = 0;       // Cells packed holds
+        size_t footprint = 0;        // Bytes counted against the budget
+        bool compressed = false;     // Guarded by mutex_
+        bool dropped = false;        // Guarded by mutex_
+    };
+
+    // Removes the newest count rows
+    void pop(size_t count) {
+        for (; count > 0 && rows_ > 0; --count) {
+            if (!open_ || open_->ends.empty()) reopen();
+            open_->ends.pop_back();
+            size_t r = open_->ends.size();
+            open_->wrapped[r / 64] &= ~(uint64_t{1} << (r % 64));
+            open_->cells.resize(r == 0 ? 0 : open_->ends.back());
+            --rows_;
+        }
+    }
+
+    // Replaces the newest sealed page with an open copy of it, for pop()
+    void reopen() {
+        std::shared_ptr<Page> page = pages_.back();
+        auto copy = std::make_shared<Page>();
+        copy->ends = page->ends;
+        std::memcpy(copy->wrapped, page->wrapped, sizeof(copy->wrapped));
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (page->compressed) {
+            // Compressed data is never modified again, so it is read unlocked
+            lock.unlock();
+            if (!unpack(*page, copy->cells)) copy->cells.assign(page->cell_count, blankCell(0));
+            lock.lock();
+        } else {
+            copy->cells = page->cells;
+        }
+        // The compressor discards its work on a page dropped meanwhile
+        page->dropped = true;
+        bytes_ -= page->footprint;
+        if (page->compressed) --compressed_pages_;
+        pages_.pop_back();
+        lock.unlock();
+        if (cache_page_ == page) cache_page_.reset();
+        open_ = std::move(copy);
+    }
+
+    bool wrapped(size_t index) const {
+        size_t page_index = index / kRowsPerPage;
+        const Page& page = page_index == pages_.size() ? *open_ : *pages_[page_index];
+        size_t r = index % kRowsPerPage;
+        return page.wrapped[r / 64] >> (r % 64) & 1;
+    }
+
+    // Length of the row without trailing default blanks
+    static size_t trimmedLength(const Cell* cells, size_t count) {
+        uint64_t blank, cell;
+        Cell b = blankCell(0);
+        std::memcpy(&blank, &b, sizeof(blank));
+        while (count > 0) {
+            std::memcpy(&cell, &cells[count - 1], sizeof(cell));
+            if (cell != blank) break;
+            --count;
+        }
+        return count;
+    }
+
+    static bool copyRow(const Page& page, const Cell* cells, size_t r, std::vector<Cell>& out) {
+        size_t begin = r == 0 ? 0 : page.ends[r - 1];
+        out.assign(cells + begin, cells + page.ends[r]);
+        return true;
+    }
+
+    size_t openBytes() const {
+        return open_ ? open_->cells.capacity() * sizeof(Cell) + open_->ends.capacity() * sizeof(uint32_t) : 0;
+    }
+
+    // Moves the full open page into the ring, queues the page that just left
+    // the hot window for compression and enforces the budget
+    void seal() {
+        open_->cells.shrink_to_fit();
+        open_->cell_count = open_->cells.size();
+        listStyles(*open_);
+        open_->footprint = open_->cells.capacity() * sizeof(Cell) + metadataBytes(*open_);
+
+        std::unique_lock<std::mutex> lock(mutex_);
+        bytes_ += open_->footprint;
+        pages_.push_back(std::move(open_));
+        if (pages_.size() > kHotPages) {
+            jobs_.push_back(pages_[pages_.size() - 1 - kHotPages]);
+            wake_.notify_one();
+        }
+        // During bursts the compressor falls behind; catch up here before
+        // giving up history, which also paces the burst to the compressor
+        while (bytes_ > budget_ && !jobs_.empty()) {
+            std::shared_ptr<Page> page = std::move(jobs_.front());
+            jobs_.pop_front();
+            compress(page, planes_, lock);
+        }
+        // Always keep the newest page, however small the budget
+        while (bytes_ > budget_ && pages_.size() > 1) {
+            Page& oldest = *pages_.front();
+            oldest.dropped = true;
+            bytes_ -= oldest.footprint;
+            if (oldest.compressed) --compressed_pages_;
+            if (cache_page_ == pages_.front()) cache_page_.reset();
+            pages_.pop_front();
+            rows_ -= kRowsPerPage;
+            dropped_rows_ += kRowsPerPage;
+        }
+    }
+
+    static size_t metadataBytes(const Page& page) {
+        return page.ends.capacity() * sizeof(uint32_t) + page.styles.capacity() * sizeof(uint16_t) +
+               page.clusters.capacity() * sizeof(char32_t);
+    }
+
+    // Fills page.styles from its cells, using a bit per possible index, and
+    // page.clusters, which are rare
+    void listStyles(Page& page) {
+        seen_.assign(StyleTable::kMaxStyles / 64, 0);
+        for (const Cell& cell : page.cells) {
+            if (StyleTable::isCluster(cell.codepoint)) page.clusters.push_back(cell.codepoint);
+            uint64_t& word = seen_[cell.style >> 6];
+            uint64_t bit = uint64_t{1} << (cell.style & 63);
+            if (word & bit) continue;
+            word |= bit;
+            page.styles.push_back(cell.style);
+        }
+        page.styles.shrink_to_fit();
+        std::sort(page.clusters.begin(), page.clusters.end());
+        page.clusters.erase(std::unique(page.clusters.begin(), page.clusters.end()), page.clusters.end());
+        page.clusters.shrink_to_fit();
+    }
+
+    // Compressor thread: packs queued pages until the destructor stops it
+    void run() {
+        std::vector<uint8_t> planes;
+        std::unique_lock<std::mutex> lock(mutex_);
+        for (;;) {
+            wake_.wait(lock, [this] { return stopping_ || !jobs_.empty(); });
+            if (stopping_) return;
+            std::shared_ptr<Page> page = std::move(jobs_.front());
+            jobs_.pop_front();
+            compress(page, planes, lock);
+        }
+    }
+
+    // Replaces a sealed page's cells with their compressed form. Called with
+    // lock held; it is released while compressing.
+    void compress(const std::shared_ptr<Page>& page, std::vector<uint8_t>& planes,
+                  std::unique_lock<std::mutex>& lock) {
+        // Reopening a page shifts the hot window, so a page can be queued twice
+        if (page->dropped || page->compressed) return;
+        lock.unlock();
+
+        // Sealed cells are immutable until compressed is set, so they are
+        // read without the lock
+        std::vector<uint8_t> packed;
+        splitPlanes(page->cells.data(), page->cell_count, planes);
+        lz::compress(planes.data(), planes.size(), packed);
+        packed.shrink_to_fit();
+
+        lock.lock();
+        if (page->dropped || page->compressed) return;
+        bytes_ -= page->footprint;
+        page->packed = std::move(packed);
+        std::vector<Cell>().swap(page->cells);
+        page->footprint = page->packed.capacity() + metadataBytes(*page);
+        page->compressed = true;
+        bytes_ += page->footprint;
+        ++compressed_pages_;
+    }
+
+    // Byte i of every cell goes to plane i
+    static void splitPlanes(const Cell* cells, size_t count, std::vector<uint8_t>& planes) {
+        planes.resize(count * sizeof(Cell));
+        const uint8_t* src = reinterpret_cast<const uint8_t*>(cells);
+        for (size_t b = 0; b < sizeof(Cell); ++b) {
+            uint8_t* plane = planes.data() + b * count;
+            for (size_t i = 0; i < count; ++i) plane[i] = src[i * sizeof(Cell) + b];
+        }
+    }
+
+    bool unpack(const Page& page, std::vector<Cell>& cells) {
+        size_t count = page.cell_count;
+        planes_.resize(count * sizeof(Cell));
+        if (!lz::decompress(page.packed.data(), page.packed.size(), planes_.data(), planes_.size())) return false;
+        cells.resize(count);
+        uint8_t* dst = reinterpret_cast<uint8_t*>(cells.data());
+        for (size_t b = 0; b < sizeof(Cell); ++b) {
+            const uint8_t* plane = planes_.data() + b * count;
+            for (size_t i = 0; i < count; ++i) dst[i * sizeof(Cell) + b] = plane[i];
+        }
+        return true;
+    }
+
+    const size_t budget_;
+    std::deque<std::shared_ptr<Page>> pages_; // Sealed pages, oldest first; main thread only
+    std::shared_ptr<Page> open_;              // Page being filled; main thread only
+    size_t rows_ = 0;
+    uint64_t dropped_rows_ = 0;
+
+    std::shared_ptr<Page> cache_page_;        // Compressed page unpacked in cache_cells_
+    std::vector<Cell> cache_cells_;
+    std::vector<uint8_t> planes_;             // Main thread scratch space for (un)packing
+    std::vector<uint64_t> seen_;              // Main thread scratch space for listStyles()
+
+    std::vector<Cell> reflow_source_;         // Main thread scratch space for popLine()
+    std::vector<Cell> reflow_row_;
+    std::vector<Cell> reflow_cells_;
+
+    mutable std::mutex mutex_;                // Guards the fields below and page flags
+    std::condition_variable wake_;
+    std::deque<std::shared_ptr<Page>> jobs_;  // Pages waiting for the compressor
+    size_t bytes_ = 0;                        // Footprint of the sealed pages
+    size_t compressed_pages_ = 0;
+    bool stopping_ = false;
+    std::thread thread_;
+};
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+// Scanners for the printable runs that make up most shell output.
+//
+// asciiRun() finds the first byte below 0x20, DEL, or 0x80 and above, 16
+// (SSE2) or 32 (AVX2) bytes at a time. The widest variant the CPU supports is
+// picked once at startup; other architectures use the scalar loop.
+
+namespace simd_scan {
+
+inline bool printableAscii(unsigned char c) {
+    return c >= 0x20 && c < 0x7F;
+}
+
+inline size_t asciiRunScalar(const char* data, size_t count) {
+    size_t i = 0;
+    while (i < count && printableAscii(static_cast<unsigned char>(data[i]))) ++i;
+    return i;
+}
+
+#if defined(__SSE2__)
+// Signed compares make 0x80-0xFF negative, so one "greater than 0x1F" test
+// excludes both controls and non-ASCII; DEL is tested separately
+inline size_t asciiRunSse2(const char* data, size_t count) {
+    const __m128i low = _mm_set1_epi8(0x1F);
+    const __m128i del = _mm_set1_epi8(0x7F);
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        __m128i ok = _mm_andnot_si128(_mm_cmpeq_epi8(chunk, del), _mm_cmpgt_epi8(chunk, low));
+        unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(ok)) ^ 0xFFFFu;
+        if (mask) return i + __builtin_ctz(mask);
+    }
+    return i + asciiRunScalar(data + i, count - i);
+}
+#endif
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define SIMD_SCAN_HAVE_AVX2 1
+__attribute__((target("avx2")))
+inline size_t asciiRunAvx2(const char* data, size_t count) {
+    const __m256i low = _mm256_set1_epi8(0x1F);
+    const __m256i del = _mm256_set1_epi8(0x7F);
+    size_t i = 0;
+    for (; i + 32 <= count; i += 32) {
+        __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+        __m256i ok = _mm256_andnot_si256(_mm256_cmpeq_epi8(chunk, del), _mm256_cmpgt_epi8(chunk, low));
+        uint32_t mask = ~static_cast<uint32_t>(_mm256_movemask_epi8(ok));
+        if (mask) return i + __builtin_ctz(mask);
+    }
+    return i + asciiRunSse2(data + i, count - i);
+}
+#endif
+
+// True when AVX2 code paths may be used on this CPU
+inline bool haveAvx2() {
+#if defined(SIMD_SCAN_HAVE_AVX2)
+    static const bool supported = [] {
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx2") != 0;
+    }();
+    return supported;
+#else
+    return false;
+#endif
+}
+
+using RunScanner = size_t (*)(const char*, size_t);
+
+inline RunScanner selectAsciiRun() {
+#if defined(SIMD_SCAN_HAVE_AVX2)
+    if (haveAvx2()) return asciiRunAvx2;
+#endif
+#if defined(__SSE2__)
+    return asciiRunSse2;
+#else
+    return asciiRunScalar;
+#endif
+}
+
+inline const RunScanner kAsciiRun = selectAsciiRun();
+
+} // namespace simd_scan
+
+// Length of the leading run of printable ASCII (0x20-0x7E)
+inline size_t asciiRun(const char* data, size_t count) {
+    return simd_scan::kAsciiRun(data, count);
+}
+
+// Length of the leading run without C0 controls or DEL. Bytes 0x80 and above
+// are UTF-8 text and stay in the run; they are skipped a byte at a time, so
+// runs of plain ASCII take the vector path.
+inline size_t textRun(const char* data, size_t count) {
+    size_t i = 0;
+    while (i < count) {
+        i += asciiRun(data + i, count - i);
+        size_t start = i;
+        while (i < count && static_cast<unsigned char>(data[i]) >= 0x80) ++i;
+        if (i == start) break;
+    }
+    return i;
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <unistd.h>
+#include <fcntl.h>
+
+// Kernel pipe used as the intermediate buffer for splice(): data moves from
+// one descriptor to another without ever being copied into user space.
+class SplicePipe {
+public:
+    SplicePipe() {
+        if (pipe2(fds_, O_NONBLOCK | O_CLOEXEC) == -1) {
+            throw std::runtime_error("Failed to create splice pipe: " + std::string(std::strerror(errno)));
+        }
+        // Best effort: a larger pipe lets one splice carry a whole burst
+        int size = fcntl(fds_[1], F_SETPIPE_SZ, kPipeSize);
+        capacity_ = size > 0 ? static_cast<size_t>(size) : kDefaultPipeSize;
+    }
+
+    ~SplicePipe() {
+        close(fds_[0]);
+        close(fds_[1]);
+    }
+
+    SplicePipe(const SplicePipe&) = delete;
+    SplicePipe& operator=(const SplicePipe&) = delete;
+
+    size_t buffered() const { return buffered_; }
+    bool full() const { return buffered_ >= capacity_; }
+
+    // Moves available bytes from in_fd into the pipe; same contract as read()
+    ssize_t fill(int in_fd) {
+        ssize_t moved = splice(in_fd, nullptr, fds_[1], nullptr, capacity_ - buffered_,
+                               SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        if (moved > 0) buffered_ += moved;
+        return moved;
+    }
+
+    // Moves buffered bytes from the pipe to out_fd; same contract as write()
+    ssize_t drain(int out_fd) {
+        ssize_t moved = splice(fds_[0], nullptr, out_fd, nullptr, buffered_,
+                               SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        if (moved > 0) buffered_ -= moved;
+        return moved;
+    }
+
+private:
+    static constexpr int kPipeSize = 1024 * 1024;
+    static constexpr size_t kDefaultPipeSize = 65536;
+
+    int fds_[2];
+    size_t buffered_ = 0;
+    size_t capacity_ = 0;
+};
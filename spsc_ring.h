@@ -0,0 +1,82 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+
+// Lock-free single-producer/single-consumer byte ring.
+//
+// Positions increase monotonically and are masked into a power-of-two
+// buffer. Each side keeps its own position and a cached copy of the other
+// side's on a separate cache line, so the producer and consumer only touch
+// shared lines when their cached view runs out.
+class SpscByteRing {
+public:
+    struct Span {
+        char* data;
+        size_t size;
+    };
+
+    explicit SpscByteRing(size_t capacity) {
+        // Doubling past the top bit would wrap size to 0 and never end
+        if (capacity > (SIZE_MAX >> 1) + 1) throw std::length_error("ring capacity too large");
+        size_t size = 1;
+        while (size < capacity) size <<= 1;
+        data_.reset(new char[size]);
+        mask_ = size - 1;
+    }
+
+    SpscByteRing(const SpscByteRing&) = delete;
+    SpscByteRing& operator=(const SpscByteRing&) = delete;
+
+    size_t capacity() const { return mask_ + 1; }
+
+    // Producer: largest contiguous free region (empty when the ring is full)
+    Span writable() {
+        size_t tail = tail_.load(std::memory_order_relaxed);
+        if (tail - cached_head_ == capacity()) {
+            cached_head_ = head_.load(std::memory_order_acquire);
+        }
+        size_t free = capacity() - (tail - cached_head_);
+        size_t offset = tail & mask_;
+        return {data_.get() + offset, std::min(free, capacity() - offset)};
+    }
+
+    // Producer: publishes count bytes written into the last writable() span
+    void commit(size_t count) {
+        tail_.store(tail_.load(std::memory_order_relaxed) + count, std::memory_order_release);
+    }
+
+    // Consumer: largest contiguous filled region (empty when the ring is empty)
+    Span readable() {
+        size_t head = head_.load(std::memory_order_relaxed);
+        if (cached_tail_ == head) {
+            cached_tail_ = tail_.load(std::memory_order_acquire);
+        }
+        size_t used = cached_tail_ - head;
+        size_t offset = head & mask_;
+        return {data_.get() + offset, std::min(used, capacity() - offset)};
+    }
+
+    // Consumer: frees count bytes from the front of the last readable() span
+    void release(size_t count) {
+        head_.store(head_.load(std::memory_order_relaxed) + count, std::memory_order_release);
+    }
+
+private:
+    static constexpr size_t kCacheLine = 64;
+
+    // Consumer-owned line
+    alignas(kCacheLine) std::atomic<size_t> head_{0};
+    size_t cached_tail_ = 0;
+
+    // Producer-owned line
+    alignas(kCacheLine) std::atomic<size_t> tail_{0};
+    size_t cached_head_ = 0;
+
+    alignas(kCacheLine) std::unique_ptr<char[]> data_;
+    size_t mask_ = 0;
+};
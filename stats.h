@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstdint>
+#include <ostream>
+
+// I/O counters reported on exit with --stats
+struct IoStats {
+    uint64_t output_wakeups = 0; // Shell output handler invocations that moved data
+    uint64_t output_reads = 0;   // read() calls returning shell output
+    uint64_t output_bytes = 0;   // Bytes of shell output forwarded
+    uint64_t output_writes = 0;  // Write syscalls (io_uring_enter with --io-uring) for shell output
+    size_t peak_read_buffer = 0; // Largest adaptive read buffer used
+    uint64_t queued_writes = 0;  // Writes queued with the output aggregator
+    uint64_t write_calls = 0;    // writev() calls the aggregator needed for them
+    size_t peak_queue_depth = 0; // Largest backlog queued for one descriptor
+    uint64_t blocked_flushes = 0;// Flushes that hit EAGAIN and left a backlog
+    uint64_t pty_pauses = 0;     // Times PTY reads were paused for backpressure
+    uint64_t dropped_bytes = 0;  // Output discarded by the drop policy
+    uint64_t spilled_bytes = 0;  // Output written to the spill file
+    uint64_t reader_stalls = 0;  // Times the reader thread found its ring full
+    uint64_t signals = 0;        // Signals read from the signalfd
+    uint64_t resizes = 0;        // TIOCSWINSZ calls they resulted in
+    size_t scrollback_rows = 0;  // Rows held in the screen model's scrollback
+    size_t scrollback_bytes = 0; // Memory they take
+    size_t scrollback_compressed_pages = 0; // Pages of them held compressed
+    uint64_t scrollback_dropped_rows = 0;   // Rows discarded to stay within the budget
+    uint64_t frames = 0;         // Frames sent by the diff renderer
+    uint64_t frame_bytes = 0;    // Bytes in them
+
+    void print(std::ostream& out) const {
+        out << "shell output: " << output_bytes << " bytes, "
+            << output_reads << " reads, " << output_writes << " writes, "
+            << output_wakeups << " wakeups";
+        if (output_wakeups) out << " (" << output_bytes / output_wakeups << " bytes/wakeup)";
+        out << "\nread buffer peak: " << peak_read_buffer << " bytes\n";
+        out << "coalesced writes: " << queued_writes << " queued, " << write_calls << " writev calls\n";
+        out << "output queue: peak " << peak_queue_depth << " bytes, blocked " << blocked_flushes
+            << " times, PTY paused " << pty_pauses << " times, " << dropped_bytes << " bytes dropped, "
+            << spilled_bytes << " bytes spilled\n";
+        out << "signals: " << signals << " received, " << resizes << " resizes applied\n";
+        if (scrollback_rows || scrollback_dropped_rows) {
+            out << "scrollback: " << scrollback_rows << " rows in " << scrollback_bytes << " bytes, "
+                << scrollback_compressed_pages << " pages compressed, " << scrollback_dropped_rows
+                << " rows dropped\n";
+        }
+        if (frames) out << "render: " << frames << " frames, " << frame_bytes << " bytes\n";
+        if (reader_stalls) out << "reader thread: ring full " << reader_stalls << " times\n";
+    }
+};
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+// Bump allocator for strings that live as long as the arena. Strings are
+// copied back to back into 1 MiB chunks and named by their offset across
+// all chunks; a string never straddles two chunks, and chunks never move,
+// so views stay valid. Storing a string allocates only when a chunk fills,
+// and chunk pages are touched only as they are written.
+class StringArena {
+public:
+    static constexpr size_t kChunkBits = 20;
+    static constexpr size_t kChunkSize = size_t{1} << kChunkBits;
+    static constexpr size_t kMaxLength = kChunkSize; // Longest string stored
+
+    // Copies s, truncated to kMaxLength, and returns its offset
+    uint64_t store(std::string_view s) {
+        size_t length = std::min(s.size(), kMaxLength);
+        if (chunks_.empty() || kChunkSize - used_ < length) {
+            chunks_.push_back(std::unique_ptr<char[]>(new char[kChunkSize]));
+            used_ = 0;
+        }
+        uint64_t offset = (uint64_t{chunks_.size() - 1} << kChunkBits) | used_;
+        std::memcpy(chunks_.back().get() + used_, s.data(), length);
+        used_ += length;
+        return offset;
+    }
+
+    std::string_view view(uint64_t offset, size_t length) const {
+        return std::string_view(chunks_[offset >> kChunkBits].get() + (offset & (kChunkSize - 1)), length);
+    }
+
+    // Bytes reserved for chunks
+    size_t capacity() const { return chunks_.size() * kChunkSize; }
+
+private:
+    std::vector<std::unique_ptr<char[]>> chunks_;
+    size_t used_ = 0; // Bytes filled in the last chunk
+};
@@ -0,0 +1,243 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Colors are packed as a tag in the top byte and a value below it
+namespace color {
+constexpr uint32_t kDefault = 0;
+constexpr uint32_t kPaletteTag = 1u << 24;
+constexpr uint32_t kRgbTag = 2u << 24;
+
+constexpr uint32_t palette(unsigned index) { return kPaletteTag | (index & 0xFF); }
+constexpr uint32_t rgb(unsigned r, unsigned g, unsigned b) {
+    return kRgbTag | (r & 0xFF) << 16 | (g & 0xFF) << 8 | (b & 0xFF);
+}
+constexpr bool isPalette(uint32_t c) { return (c & 0xFF000000u) == kPaletteTag; }
+constexpr bool isRgb(uint32_t c) { return (c & 0xFF000000u) == kRgbTag; }
+} // namespace color
+
+// SGR attributes of a cell, plus the OSC 8 hyperlink it belongs to
+struct Style {
+    enum Flag : uint16_t {
+        kBold      = 1u << 0,
+        kDim       = 1u << 1,
+        kItalic    = 1u << 2,
+        kBlink     = 1u << 3,
+        kInverse   = 1u << 4,
+        kHidden    = 1u << 5,
+        kStrike    = 1u << 6,
+        kOverline  = 1u << 7,
+    };
+
+    uint32_t fg = color::kDefault;
+    uint32_t bg = color::kDefault;
+    uint32_t underline_color = color::kDefault;
+    uint16_t flags = 0;
+    uint16_t link = 0;     // Index into the StyleTable's links, 0 for none
+    uint8_t underline = 0; // 0 none, 1 single, 2 double, 3 curly, 4 dotted, 5 dashed
+
+    bool operator==(const Style& other) const {
+        return fg == other.fg && bg == other.bg && underline_color == other.underline_color &&
+               flags == other.flags && link == other.link && underline == other.underline;
+    }
+    bool operator!=(const Style& other) const { return !(*this == other); }
+};
+
+struct StyleHash {
+    size_t operator()(const Style& s) const {
+        uint64_t h = (uint64_t{s.fg} << 32 | s.bg) * 0x9E3779B97F4A7C15ull;
+        h ^= (uint64_t{s.underline_color} << 32 | uint64_t{s.link} << 24 | uint64_t{s.flags} << 8 | s.underline) *
+             0xC2B2AE3D27D4EB4Full;
+        return static_cast<size_t>(h ^ (h >> 29));
+    }
+};
+
+// Maps each distinct Style to a small index so cells store 16 bits instead
+// of the whole attribute set, and equal styles compare as equal integers.
+// Index 0 is the default style. Hyperlink targets are interned the same way
+// and referenced from styles. Grapheme clusters of more than one codepoint
+// are interned too, and a cell stores kClusterBase plus the cluster's index
+// in place of a codepoint, so equal clusters compare as equal cells.
+//
+// Entries are reclaimed by mark and sweep: the owner of the cells calls
+// beginCollection(), marks every index still stored anywhere, and sweep()
+// frees the rest for reuse, along with links no surviving style uses.
+class StyleTable {
+public:
+    static constexpr size_t kMaxStyles = 65536;
+    static constexpr size_t kMaxLinks = 65536;
+    static constexpr size_t kMaxClusters = 1u << 20;
+    static constexpr char32_t kClusterBase = 0x110000; // Past the last Unicode codepoint
+
+    static bool isCluster(char32_t c) { return c >= kClusterBase; }
+
+    StyleTable() : styles_(1), links_(1) {
+        index_.emplace(Style{}, 0);
+    }
+
+    // Index of style, adding it if new; falls back to the default when full
+    uint16_t intern(const Style& style) {
+        // Output tends to cycle through a few styles; a direct-mapped cache
+        // answers those without probing the hash table
+        size_t hash = StyleHash()(style);
+        uint16_t& cached = cache_[hash % kCacheSize];
+        if (styles_[cached] == style) return cached;
+
+        auto it = index_.find(style);
+        if (it != index_.end()) return cached = it->second;
+        uint16_t id;
+        if (!free_.empty()) {
+            id = free_.back();
+            free_.pop_back();
+            styles_[id] = style;
+        } else if (styles_.size() < kMaxStyles) {
+            id = static_cast<uint16_t>(styles_.size());
+            styles_.push_back(style);
+        } else {
+            return 0;
+        }
+        index_.emplace(style, id);
+        return cached = id;
+    }
+
+    const Style& get(uint16_t id) const { return styles_[id]; }
+
+    // Styles currently interned
+    size_t size() const { return styles_.size() - free_.size(); }
+
+    // Index of a hyperlink ("params;uri" of OSC 8), 0 for an empty uri or when full
+    uint16_t internLink(const std::string& target) {
+        if (target.empty() || target.back() == ';') return 0;
+        auto it = link_index_.find(target);
+        if (it != link_index_.end()) return it->second;
+        uint16_t id;
+        if (!free_links_.empty()) {
+            id = free_links_.back();
+            free_links_.pop_back();
+            links_[id] = target;
+        } else if (links_.size() < kMaxLinks) {
+            id = static_cast<uint16_t>(links_.size());
+            links_.push_back(target);
+        } else {
+            return 0;
+        }
+        link_index_.emplace(target, id);
+        return id;
+    }
+
+    const std::string& link(uint16_t id) const { return links_[id]; }
+
+    // Cell codepoint naming cluster, or 0 when the table is full
+    char32_t internCluster(const std::u32string& cluster) {
+        auto it = cluster_index_.find(cluster);
+        if (it != cluster_index_.end()) return kClusterBase + it->second;
+        uint32_t id;
+        if (!free_clusters_.empty()) {
+            id = free_clusters_.back();
+            free_clusters_.pop_back();
+            clusters_[id] = cluster;
+        } else if (clusters_.size() < kMaxClusters) {
+            id = static_cast<uint32_t>(clusters_.size());
+            clusters_.push_back(cluster);
+        } else {
+            return 0;
+        }
+        cluster_index_.emplace(cluster, id);
+        return kClusterBase + id;
+    }
+
+    // Codepoints of the cluster a cell codepoint names
+    const std::u32string& cluster(char32_t c) const { return clusters_[c - kClusterBase]; }
+
+    // Clusters currently interned
+    size_t clusters() const { return clusters_.size() - free_clusters_.size(); }
+
+    // Collection
+
+    void beginCollection() {
+        marks_.assign(styles_.size(), 0);
+        marks_[0] = 1;
+        link_marks_.assign(links_.size(), 0);
+        link_marks_[0] = 1;
+        cluster_marks_.assign(clusters_.size(), 0);
+    }
+
+    void mark(uint16_t id) { marks_[id] = 1; }
+    void markLink(uint16_t id) { link_marks_[id] = 1; }
+    void markCluster(char32_t c) { cluster_marks_[c - kClusterBase] = 1; }
+
+    // Marks the style and any cluster of each of count cells
+    template <typename Cell>
+    void markCells(const Cell* cells, size_t count) {
+        for (size_t i = 0; i < count; ++i) {
+            marks_[cells[i].style] = 1;
+            if (isCluster(cells[i].codepoint)) markCluster(cells[i].codepoint);
+        }
+    }
+
+    // Frees every unmarked style, link and cluster; returns the number of
+    // styles freed
+    size_t sweep() {
+        size_t freed = 0;
+        free_.clear();
+        for (size_t id = 1; id < styles_.size(); ++id) {
+            if (marks_[id]) {
+                link_marks_[styles_[id].link] = 1;
+                continue;
+            }
+            auto it = index_.find(styles_[id]);
+            if (it != index_.end() && it->second == id) {
+                index_.erase(it);
+                ++freed;
+            }
+            free_.push_back(static_cast<uint16_t>(id));
+        }
+        free_links_.clear();
+        for (size_t id = 1; id < links_.size(); ++id) {
+            if (link_marks_[id]) continue;
+            link_index_.erase(links_[id]);
+            std::string().swap(links_[id]);
+            free_links_.push_back(static_cast<uint16_t>(id));
+        }
+        free_clusters_.clear();
+        for (size_t id = 0; id < clusters_.size(); ++id) {
+            if (cluster_marks_[id]) continue;
+            cluster_index_.erase(clusters_[id]);
+            std::u32string().swap(clusters_[id]);
+            free_clusters_.push_back(static_cast<uint32_t>(id));
+        }
+        // Cached indices may now name freed or reused entries
+        std::fill(std::begin(cache_), std::end(cache_), 0);
+        // Free entries at the end are released; the rest are handed out
+        // lowest first so the table can shrink at the next collection
+        while (!free_.empty() && free_.back() == styles_.size() - 1) {
+            free_.pop_back();
+            styles_.pop_back();
+        }
+        std::reverse(free_.begin(), free_.end());
+        return freed;
+    }
+
+private:
+    static constexpr size_t kCacheSize = 64;
+
+    std::vector<Style> styles_;
+    std::vector<uint16_t> free_;  // Swept style indices, lowest last
+    uint16_t cache_[kCacheSize] = {};
+    std::unordered_map<Style, uint16_t, StyleHash> index_;
+    std::vector<std::string> links_;
+    std::vector<uint16_t> free_links_;
+    std::unordered_map<std::string, uint16_t> link_index_;
+    std::vector<std::u32string> clusters_;
+    std::vector<uint32_t> free_clusters_;
+    std::unordered_map<std::u32string, uint32_t> cluster_index_;
+    std::vector<uint8_t> marks_;
+    std::vector<uint8_t> link_marks_;
+    std::vector<uint8_t> cluster_marks_;
+};
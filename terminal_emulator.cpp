@@ -1,5 +1,9 @@
+#include <cctype>
+#include <chrono>
+#include <climits>
 #include <iostream>
 #include <string>
+#include <string_view>
 #include <vector>
 #include <unistd.h>
 #include <fcntl.h>
@@ -9,8 +13,47 @@
 #include <signal.h>
 #include <sys/wait.h>
 #include <sys/ioctl.h>
+#include <sys/signalfd.h>
+#include <sys/syscall.h>
 #include <stdexcept>
 #include <cstring>
+#include <ctime>
+#include <memory>
+#include <getopt.h>
+
+#include "adaptive_buffer.h"
+#include "event_loop.h"
+#include "fuzzy_finder.h"
+#include "history_log.h"
+#include "history_rank.h"
+#include "history_search.h"
+#include "output_aggregator.h"
+#include "pty_reader.h"
+#include "renderer.h"
+#include "screen.h"
+#include "splice_pipe.h"
+#include "stats.h"
+#include "uring.h"
+#include "vt_parser.h"
+
+// Runtime configuration parsed from the command line
+struct Options {
+    std::string event_loop = "epoll"; // Event loop backend: "epoll" or "poll"
+    bool io_uring = false;            // Pump shell output through io_uring when available
+    size_t max_read_buffer = 256 * 1024; // Ceiling for the adaptive shell output buffer
+    bool passthrough = false;         // Splice shell output to stdout when nothing inspects it
+    size_t output_queue_limit = 4 * 1024 * 1024; // Bytes of stdout backlog held in memory
+    OverflowPolicy overflow = OverflowPolicy::kBlock; // What happens once the backlog is full
+    bool threaded = false;            // Drain the PTY on a dedicated reader thread
+    size_t reader_ring_size = 4 * 1024 * 1024; // Bytes buffered between reader thread and loop
+    int kill_timeout_ms = 2000;       // Wait before escalating a termination signal
+    bool screen_model = false;        // Keep an in-memory model of the shell's screen
+    size_t scrollback_limit = 8 * 1024 * 1024; // Memory budget for the screen model's scrollback
+    bool diff_render = false;         // Draw the screen model on the host instead of forwarding output
+    int max_fps = 60;                 // Frame rate cap for the diff renderer, 0 for none
+    std::string history_file;         // Command history log kept across sessions, empty for none
+    bool stats = false;               // Print I/O statistics on exit
+};
 
 class TerminalEmulator {
 private:
@@ -20,20 +63,96 @@ private:
     bool is_running_ = false;         // Emulator running state
 
     std::string input_buffer_;        // Current user input
-    std::vector<std::string> history_;// Command history
-    size_t history_index_ = 0;        // Current history navigation index
+    std::string escape_sequence_;     // Raw bytes of a partially received key sequence
+    VtParser input_parser_;           // Parses keystrokes from stdin
+    VtParser output_parser_;          // Parses shell output for the screen model and modes
+    std::unique_ptr<Screen> screen_;  // Model of the shell's screen, with --screen-model
+    std::unique_ptr<Renderer> renderer_; // Presents screen_ on the host, with --diff-render
+    std::string frame_;               // Scratch buffer for rendered frames
+    std::string dcs_;                 // DCS string being collected for the host
+    bool frame_pending_ = false;      // Model changed since the last frame
+    int frame_timer_ = -1;            // Fires when the next capped frame is due
+    bool frame_timer_armed_ = false;
+    std::chrono::steady_clock::duration frame_interval_{}; // Minimum time between frames
+    std::chrono::steady_clock::time_point last_frame_;     // When the last frame was sent
+    std::chrono::steady_clock::time_point input_deadline_; // Frames render at once until then
+    bool ss3_pending_ = false;        // Saw ESC O; the next byte completes the key
+    bool application_cursor_ = false; // Shell enabled application cursor keys (DECCKM)
+    bool alternate_screen_ = false;   // Shell switched to the alternate screen
+    HistoryLog history_;              // Command history, persisted with --history-file
+    HistoryRanking history_ranking_{history_}; // Distinct commands by frecency
+    const HistoryRanking::Entry* history_cursor_ = nullptr; // Entry shown by the arrows, if any
+    HistorySearch history_search_{history_ranking_}; // Index behind Ctrl-R
+    bool searching_ = false;          // Ctrl-R search prompt is showing
+    bool search_pending_ = false;     // Search stopped partway; resumed between events
+    std::string search_query_;
+    const HistoryRanking::Entry* search_cursor_ = nullptr; // Where the search resumes
+    const HistoryRanking::Entry* search_match_ = nullptr;  // Entry shown by the search prompt, if any
+    bool fuzzy_ = false;              // The search prompt ranks fuzzy matches (Tab toggles)
+    size_t fuzzy_rank_ = 0;           // Rank of the fuzzy result shown, 0 for the best
+    std::unique_ptr<FuzzyFinder> finder_; // Worker pool behind the fuzzy prompt, once used
 
-    static TerminalEmulator* instance_; // Singleton instance for signal handling
+    Options options_;                 // Runtime configuration
+    std::unique_ptr<EventLoop> loop_; // Readiness backend driving processIO
+    std::unique_ptr<UringPump> uring_;// io_uring shell output path, if active
+    std::unique_ptr<SplicePipe> splice_; // Zero-copy passthrough path, if active
+    std::unique_ptr<PtyReader> reader_;  // Reader thread feeding shell output, if active
+    int stdin_flags_ = -1;            // Original stdin file status flags
+    int stdout_flags_ = -1;           // Original stdout file status flags
+    bool stdout_watched_ = false;     // Waiting for stdout to become writable
+    bool master_paused_ = false;      // PTY reads paused while stdout is backed up
+    bool splice_broken_ = false;      // Kernel rejected splice; drain the pipe and stop using it
+    char buffer_[1024];               // Scratch buffer for user input
+    AdaptiveBuffer output_buffer_;    // Shell output buffer, sized to the traffic
+    OutputAggregator output_;         // Per-iteration write queues, flushed with writev
+    IoStats stats_;                   // Counters reported with --stats
+
+    sigset_t original_sigmask_;       // Signal mask to restore on exit and in the child
+    int signal_fd_ = -1;              // signalfd delivering SIGWINCH, SIGCHLD, SIGINT, SIGTERM
+    int pidfd_ = -1;                  // pidfd for the shell; readable once it exits
+    int escalation_timer_ = -1;       // Timer escalating an unanswered termination signal
+    int kill_stage_ = 0;              // 0 none, 1 SIGINT, 2 SIGTERM, 3 SIGKILL sent
 
 public:
-    TerminalEmulator() {
+    explicit TerminalEmulator(const Options& options)
+        : options_(options), output_buffer_(kMinReadBuffer, options.max_read_buffer) {
+        loop_ = EventLoop::create(options_.event_loop);
+        std::string error;
+        if (!options_.history_file.empty() && !history_.open(options_.history_file, error)) {
+            std::cerr << "History not saved: " << error << std::endl;
+        }
         configureTerminal();
-        setupSignalHandlers();
+        setupSignalFd();
         initializePty();
     }
 
     ~TerminalEmulator() {
+        if (uring_) {
+            stats_.output_bytes = uring_->bytesRead();
+            stats_.output_reads = uring_->readCompletions();
+            stats_.output_writes = uring_->enterCalls();
+        }
+        if (reader_) {
+            stats_.output_bytes = reader_->bytesRead();
+            stats_.output_reads = reader_->reads();
+            stats_.reader_stalls = reader_->fullStalls();
+        }
+        stats_.peak_read_buffer = output_buffer_.peakCapacity();
+        stats_.queued_writes = output_.queuedWrites();
+        stats_.write_calls = output_.writeCalls();
+        stats_.peak_queue_depth = output_.peakDepth();
+        stats_.blocked_flushes = output_.blockedFlushes();
+        stats_.dropped_bytes = output_.droppedBytes();
+        stats_.spilled_bytes = output_.spilledBytes();
+        if (screen_ && screen_->scrollback()) {
+            Scrollback& scrollback = *screen_->scrollback();
+            stats_.scrollback_rows = scrollback.size();
+            stats_.scrollback_bytes = scrollback.bytes();
+            stats_.scrollback_compressed_pages = scrollback.compressedPages();
+            stats_.scrollback_dropped_rows = scrollback.droppedRows();
+        }
         cleanup();
+        if (options_.stats) stats_.print(std::cerr);
     }
 
     // Runs the terminal emulator's main I/O loop
@@ -46,37 +165,61 @@ public:
     }
 
 private:
-    // Writes data to a file descriptor with retry on interrupt
-    bool safeWrite(int fd, const void* buf, size_t count) {
-        const char* ptr = static_cast<const char*>(buf);
-        size_t remaining = count;
-
-        while (remaining > 0) {
-            ssize_t written = write(fd, ptr, remaining);
-            if (written == -1) {
-                if (errno == EINTR) continue;
-                std::cerr << "Write error: " << std::strerror(errno) << std::endl;
-                return false;
-            }
-            ptr += written;
-            remaining -= written;
-        }
-        return true;
-    }
-
     // Restores terminal settings and cleans up resources
     void cleanup() {
+        if (uring_) {
+            loop_->remove(uring_->fd());
+            uring_.reset();
+        }
+        if (reader_) {
+            loop_->remove(reader_->notifyFd());
+            reader_.reset();
+        }
+        if (finder_) {
+            loop_->remove(finder_->notifyFd());
+            finder_.reset();
+        }
         if (master_fd_ != -1) {
+            output_.discard(master_fd_);
+            if (loop_) loop_->remove(master_fd_);
             close(master_fd_);
             master_fd_ = -1;
         }
         if (child_pid_ > 0) {
-            kill(child_pid_, SIGTERM);
-            waitpid(child_pid_, nullptr, 0);
-            child_pid_ = -1;
+            stopChild();
+        }
+        if (pidfd_ != -1) {
+            if (loop_) loop_->remove(pidfd_);
+            close(pidfd_);
+            pidfd_ = -1;
+        }
+        if (stdin_flags_ != -1) {
+            if (loop_) loop_->remove(STDIN_FILENO);
+            fcntl(STDIN_FILENO, F_SETFL, stdin_flags_);
+            stdin_flags_ = -1;
+        }
+        if (stdout_flags_ != -1) {
+            if (loop_) loop_->remove(STDOUT_FILENO);
+            fcntl(STDOUT_FILENO, F_SETFL, stdout_flags_);
+            stdout_flags_ = -1;
+            // stdout blocks again, so the remaining backlog is written out in full
+            if (splice_) flushSplicePipe();
+            if (renderer_) {
+                frame_.clear();
+                renderer_->render(*screen_, frame_);
+                // Leave the host with default attributes, no open hyperlink and a cursor
+                frame_ += "\x1B[0m\x1B]8;;\x1B\\\x1B[?25h";
+                output_.queue(STDOUT_FILENO, frame_.data(), frame_.size());
+            }
+            output_.flush(STDOUT_FILENO);
+        }
+        if (signal_fd_ != -1) {
+            if (loop_) loop_->remove(signal_fd_);
+            close(signal_fd_);
+            signal_fd_ = -1;
+            sigprocmask(SIG_SETMASK, &original_sigmask_, nullptr);
         }
         restoreTerminal();
-        instance_ = nullptr;
     }
 
     // Configures stdin for raw mode
@@ -110,14 +253,24 @@ private:
         if (ioctl(STDIN_FILENO, TIOCGWINSZ, &ws) == -1) {
             ws = {24, 80, 0, 0}; // Default size if retrieval fails
         }
+        if (options_.screen_model) {
+            screen_ = std::make_unique<Screen>(ws.ws_row ? ws.ws_row : 24, ws.ws_col ? ws.ws_col : 80,
+                                               options_.scrollback_limit);
+            if (options_.diff_render) {
+                renderer_ = std::make_unique<Renderer>();
+                screen_->setStyleRoots([this](StyleTable& styles) { renderer_->markStyles(styles); });
+            }
+        }
 
-        struct termios term;
+        // The shell's PTY starts from the host terminal's original settings
+        struct termios term = original_termios_;
         child_pid_ = forkpty(&master_fd_, nullptr, &term, &ws);
         if (child_pid_ == -1) {
             throw std::runtime_error("PTY fork failed: " + std::string(std::strerror(errno)));
         }
 
         if (child_pid_ == 0) { // Child process
+            sigprocmask(SIG_SETMASK, &original_sigmask_, nullptr);
             tcgetattr(STDIN_FILENO, &term);
             term.c_lflag &= ~ECHO;
             tcsetattr(STDIN_FILENO, TCSAFLUSH, &term);
@@ -134,80 +287,827 @@ private:
             return;
         }
         ioctl(master_fd_, TIOCSWINSZ, &ws);
+        if (screen_ && ws.ws_row && ws.ws_col) screen_->resize(ws.ws_row, ws.ws_col);
+        frame_pending_ = true;
+    }
+
+    // Blocks SIGWINCH, SIGCHLD, SIGINT and SIGTERM and routes them to a
+    // signalfd, so they are handled from the event loop instead of an async
+    // signal handler and never interrupt the loop's wait
+    void setupSignalFd() {
+        sigset_t mask;
+        sigemptyset(&mask);
+        sigaddset(&mask, SIGWINCH);
+        sigaddset(&mask, SIGCHLD);
+        sigaddset(&mask, SIGINT);
+        sigaddset(&mask, SIGTERM);
+        if (sigprocmask(SIG_BLOCK, &mask, &original_sigmask_) == -1) {
+            throw std::runtime_error("Failed to block signals: " + std::string(std::strerror(errno)));
+        }
+        signal_fd_ = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+        if (signal_fd_ == -1) {
+            sigprocmask(SIG_SETMASK, &original_sigmask_, nullptr);
+            throw std::runtime_error("signalfd failed: " + std::string(std::strerror(errno)));
+        }
     }
 
-    // Signal handler for window resize and interrupts
-    static void handleSignal(int sig) {
-        if (!instance_) return;
-        if (sig == SIGWINCH) {
-            instance_->resizePty();
-        } else if (sig == SIGINT || sig == SIGTERM) {
-            if (instance_->child_pid_ > 0) {
-                kill(instance_->child_pid_, sig);
+    // Reads every queued signal and acts once per kind, so a burst of
+    // SIGWINCH during a drag-resize costs a single TIOCSWINSZ
+    bool readSignals() {
+        bool resize = false;
+        bool child = false;
+        int forward = 0;
+
+        struct signalfd_siginfo info[16];
+        while (true) {
+            ssize_t bytes_read = read(signal_fd_, info, sizeof(info));
+            if (bytes_read == -1 && errno == EINTR) continue;
+            if (bytes_read <= 0) break;
+            size_t count = static_cast<size_t>(bytes_read) / sizeof(info[0]);
+            stats_.signals += count;
+            for (size_t i = 0; i < count; ++i) {
+                switch (info[i].ssi_signo) {
+                case SIGWINCH:
+                    resize = true;
+                    break;
+                case SIGCHLD:
+                    child = true;
+                    break;
+                case SIGINT:
+                case SIGTERM:
+                    forward = static_cast<int>(info[i].ssi_signo);
+                    break;
+                }
             }
         }
+
+        if (resize) {
+            resizePty();
+            ++stats_.resizes;
+        }
+        if (forward == SIGTERM && child_pid_ > 0) {
+            terminateChild(SIGTERM); // Escalates to SIGKILL if the shell ignores it
+        } else if (forward && child_pid_ > 0) {
+            kill(child_pid_, forward);
+        }
+        if (child) {
+            reapChild();
+        }
+        return true;
     }
 
-    // Sets up signal handlers for SIGWINCH, SIGINT, SIGTERM
-    void setupSignalHandlers() {
-        instance_ = this;
-        struct sigaction sa = {};
-        sa.sa_handler = handleSignal;
-        sigemptyset(&sa.sa_mask);
-        sigaction(SIGWINCH, &sa, nullptr);
-        sigaction(SIGINT, &sa, nullptr);
-        sigaction(SIGTERM, &sa, nullptr);
+    // Registers a pidfd for the shell so its exit is a loop event; without
+    // pidfd support (Linux < 5.3) SIGCHLD from the signalfd covers it
+    void watchChild() {
+        pidfd_ = static_cast<int>(syscall(SYS_pidfd_open, child_pid_, 0));
+        if (pidfd_ == -1) return;
+        loop_->add(pidfd_, kReadable, [this](uint32_t) {
+            reapChild();
+            return true;
+        });
     }
 
-    // Main I/O loop using poll
+    // Collects the shell's exit status without blocking
+    void reapChild() {
+        if (child_pid_ <= 0) return;
+        pid_t pid = waitpid(child_pid_, nullptr, WNOHANG);
+        if (pid != child_pid_) return;
+        child_pid_ = -1;
+        if (pidfd_ != -1) {
+            loop_->remove(pidfd_);
+            close(pidfd_);
+            pidfd_ = -1;
+        }
+        if (escalation_timer_ != -1) {
+            loop_->removeTimer(escalation_timer_);
+            escalation_timer_ = -1;
+        }
+        // Output normally ends with EOF on the master, but background jobs can
+        // keep the slave open; give buffered output a moment, then stop
+        loop_->addTimer(kExitGraceMs, 0, [this] { is_running_ = false; });
+    }
+
+    // Sends a termination signal and, if the shell ignores it, escalates to
+    // SIGTERM and then SIGKILL every kill_timeout_ms. Exit is collected
+    // asynchronously by reapChild, so this never blocks the loop.
+    bool terminateChild(int signal) {
+        if (kill(child_pid_, signal) == -1) {
+            std::cerr << "Failed to send signal to child: " << std::strerror(errno) << std::endl;
+            return false;
+        }
+        kill_stage_ = std::max(kill_stage_, signal == SIGINT ? 1 : signal == SIGTERM ? 2 : 3);
+        if (escalation_timer_ == -1) {
+            int timeout = options_.kill_timeout_ms;
+            escalation_timer_ = loop_->addTimer(timeout, timeout, [this] { escalateTermination(); });
+        }
+        return true;
+    }
+
+    // Timer callback: the shell outlived the last signal, try the next one
+    void escalateTermination() {
+        if (child_pid_ <= 0) return;
+        if (kill_stage_ >= 3) {
+            // Not even SIGKILL was collected (e.g. stuck in the kernel); stop waiting
+            std::cerr << "Child did not exit after SIGKILL" << std::endl;
+            is_running_ = false;
+            return;
+        }
+        ++kill_stage_;
+        kill(child_pid_, kill_stage_ == 2 ? SIGTERM : SIGKILL);
+    }
+
+    // Terminates the shell at shutdown, waiting at most kill_timeout_ms before SIGKILL
+    void stopChild() {
+        kill(child_pid_, SIGTERM);
+        if (!waitForChild(options_.kill_timeout_ms)) {
+            kill(child_pid_, SIGKILL);
+            waitpid(child_pid_, nullptr, 0);
+        }
+        child_pid_ = -1;
+    }
+
+    // Waits up to timeout_ms for the shell to exit and reaps it
+    bool waitForChild(int timeout_ms) {
+        if (pidfd_ != -1) {
+            struct pollfd pfd = {pidfd_, POLLIN, 0};
+            while (poll(&pfd, 1, timeout_ms) == -1 && errno == EINTR) {}
+            return waitpid(child_pid_, nullptr, WNOHANG) == child_pid_;
+        }
+        for (int waited = 0; waited <= timeout_ms; waited += 10) {
+            if (waitpid(child_pid_, nullptr, WNOHANG) == child_pid_) return true;
+            usleep(10000);
+        }
+        return false;
+    }
+
+    // Main I/O loop driven by the configured event loop backend
     void processIO() {
-        struct pollfd fds[2] = {
-            {STDIN_FILENO, POLLIN, 0},
-            {master_fd_, POLLIN, 0}
-        };
-        char buffer[1024];
-        is_running_ = true;
+        // Capture both before either changes: stdin and stdout often share one open file
+        stdout_flags_ = fcntl(STDOUT_FILENO, F_GETFL);
+        stdin_flags_ = setNonBlocking(STDIN_FILENO);
+        setNonBlocking(STDOUT_FILENO);
+        setNonBlocking(master_fd_);
+        output_.setLimit(STDOUT_FILENO, options_.output_queue_limit, options_.overflow);
+
+        loop_->add(STDIN_FILENO, kReadable, [this](uint32_t) {
+            return readUserInput();
+        });
+        loop_->add(signal_fd_, kReadable, [this](uint32_t) {
+            return readSignals();
+        });
+        watchChild();
+        if (!startUringPump() && !startReaderThread()) {
+            startPassthrough();
+        }
+        loop_->add(master_fd_, masterEvents(), [this](uint32_t events) {
+            return handleMasterEvents(events);
+        });
+        if (renderer_) startFrameTimer();
 
+        is_running_ = true;
         while (is_running_) {
-            if (poll(fds, 2, -1) == -1) {
-                if (errno == EINTR) continue;
-                throw std::runtime_error("Poll error: " + std::string(std::strerror(errno)));
+            // A search in progress, then loading the history, continue
+            // whenever no event is ready
+            loop_->runOnce(search_pending_ || loadingHistory() ? 0 : -1);
+            if (search_pending_) {
+                continueSearch();
+            } else if (loadingHistory()) {
+                history_ranking_.load();
+            }
+            if (renderer_) scheduleFrame();
+            if (!output_.blocked(master_fd_)) flushOutput(master_fd_);
+            if (!output_.blocked(STDOUT_FILENO)) flushOutput(STDOUT_FILENO);
+            updateBackpressure();
+        }
+    }
+
+    // Whether earlier sessions' commands are still being ranked. Loading
+    // pauses while the ranking is being navigated or searched.
+    bool loadingHistory() const {
+        return !history_ranking_.loaded() && !searching_ && !history_cursor_;
+    }
+
+    // Readiness the PTY master is watched for in the current state
+    uint32_t masterEvents() const {
+        uint32_t events = 0;
+        if (!uring_ && !reader_ && !master_paused_) events |= kReadable;
+        if (output_.blocked(master_fd_)) events |= kWritable;
+        return events;
+    }
+
+    // Dispatches PTY master readiness to the active output path
+    bool handleMasterEvents(uint32_t events) {
+        if (events & kWritable) flushOutput(master_fd_);
+        if (uring_ || reader_) {
+            // Registered for writes and hangup only: reads happen elsewhere
+            if (events & kHangup) {
+                loop_->remove(master_fd_);
+                if (uring_) uring_->notifyHangup();
             }
+            return true;
+        }
+        if (master_paused_ || !(events & (kReadable | kHangup))) return true;
+        if (splice_ && !splice_broken_ && !outputNeedsCopy()) return spliceShellOutput(events);
+        return readShellOutput(events);
+    }
+
+    // Writes queued output for fd without blocking and tracks writability interest
+    FlushResult flushOutput(int fd) {
+        FlushResult result = output_.flush(fd);
+        if (fd == STDOUT_FILENO) {
+            watchStdout(result == FlushResult::kBlocked || (splice_ && splice_->buffered() > 0));
+        } else if (fd == master_fd_) {
+            loop_->modify(master_fd_, masterEvents());
+        }
+        return result;
+    }
 
-            if (fds[0].revents & POLLIN) {
-                readUserInput(buffer);
+    // Registers or drops the writability watch on stdout
+    void watchStdout(bool enable) {
+        if (enable == stdout_watched_) return;
+        stdout_watched_ = enable;
+        if (!enable) {
+            loop_->remove(STDOUT_FILENO);
+            return;
+        }
+        loop_->add(STDOUT_FILENO, kWritable, [this](uint32_t) {
+            if (flushOutput(STDOUT_FILENO) == FlushResult::kFlushed && splice_) {
+                flushSplicePipe();
             }
-            if (fds[1].revents & POLLIN) {
-                readShellOutput(buffer);
+            updateBackpressure();
+            return true;
+        });
+    }
+
+    // Pauses PTY reads while stdout is backed up so the shell blocks on a full
+    // PTY, and resumes them once the backlog has drained to half the limit
+    void updateBackpressure() {
+        bool pause = master_paused_;
+        if (options_.overflow == OverflowPolicy::kBlock) {
+            size_t depth = output_.pending(STDOUT_FILENO);
+            if (depth > options_.output_queue_limit) {
+                pause = true;
+            } else if (depth <= options_.output_queue_limit / 2) {
+                pause = false;
             }
+        } else {
+            pause = false;
         }
+        // Spliced bytes bypass the queue, so the pipe itself is the backlog
+        if (splice_ && splice_->buffered() > 0) pause = true;
+
+        if (pause == master_paused_) return;
+        master_paused_ = pause;
+        if (pause) ++stats_.pty_pauses;
+        loop_->modify(master_fd_, masterEvents());
+        // The ring's notification is edge-triggered; poke it so consumption resumes
+        if (!pause && reader_) reader_->wake();
     }
 
-    // Reads and processes user input
-    void readUserInput(char* buffer) {
-        ssize_t bytes_read = read(STDIN_FILENO, buffer, 1024);
-        if (bytes_read <= 0) return;
+    // Moves shell output to stdout through io_uring; false falls back to read/write.
+    // The pump writes output as read, so it does not combine with the renderer.
+    bool startUringPump() {
+        if (!options_.io_uring || renderer_) return false;
+        try {
+            uring_ = std::make_unique<UringPump>(master_fd_, STDOUT_FILENO);
+            uring_->setObserver([this](const char* data, size_t count) {
+                observeShellOutput(data, count);
+            });
+        } catch (const std::runtime_error& e) {
+            std::cerr << "io_uring unavailable, using " << loop_->name() << ": " << e.what() << std::endl;
+            return false;
+        }
 
-        for (ssize_t i = 0; i < bytes_read; ++i) {
-            if (!processInput(buffer[i])) {
+        loop_->add(uring_->fd(), kReadable, [this](uint32_t) {
+            ++stats_.output_wakeups;
+            if (!uring_->service()) {
+                std::cerr << "Write error: io_uring output failed" << std::endl;
+                is_running_ = false;
+            }
+            if (uring_->inputClosed() && uring_->outputIdle()) {
                 is_running_ = false;
+            }
+            return true;
+        });
+        return true;
+    }
+
+    // Starts the PTY reader thread for --threaded; false keeps reads on this thread
+    bool startReaderThread() {
+        if (!options_.threaded) return false;
+        try {
+            reader_ = std::make_unique<PtyReader>(master_fd_, options_.reader_ring_size);
+        } catch (const std::exception& e) {
+            std::cerr << "Reader thread unavailable: " << e.what() << std::endl;
+            return false;
+        }
+        loop_->add(reader_->notifyFd(), kReadable, [this](uint32_t) {
+            return consumeReaderOutput();
+        });
+        return true;
+    }
+
+    // Forwards shell output the reader thread placed in the ring
+    bool consumeReaderOutput() {
+        reader_->acknowledge();
+        size_t moved = 0;
+        bool drained = false;
+        for (int round = 0; round < kReadBudget && !drained; ++round) {
+            if (master_paused_) {
+                drained = true; // Resumed through PtyReader::wake()
                 break;
             }
+
+            SpscByteRing::Span span = reader_->readable();
+            if (span.size == 0) {
+                if (reader_->closed()) {
+                    // The reader may have pushed its last bytes between the
+                    // two checks; they are visible once closed() is
+                    if (reader_->readable().size > 0) continue;
+                    is_running_ = false;
+                    drained = true;
+                } else {
+                    drained = reader_->armWakeup();
+                }
+                continue;
+            }
+            forwardShellOutput(span.data, span.size);
+            reader_->release(span.size);
+            moved += span.size;
+            updateBackpressure();
+        }
+        if (moved > 0) {
+            ++stats_.output_wakeups;
+            stats_.output_bytes += moved;
         }
+        return drained;
     }
 
-    // Reads and forwards shell output to stdout
-    void readShellOutput(char* buffer) {
-        ssize_t bytes_read = read(master_fd_, buffer, 1024);
-        if (bytes_read > 0) {
-            safeWrite(STDOUT_FILENO, buffer, bytes_read);
+    // Creates the splice pipe for --passthrough; failures leave the copy path in place
+    void startPassthrough() {
+        if (!options_.passthrough) return;
+        try {
+            splice_ = std::make_unique<SplicePipe>();
+        } catch (const std::runtime_error& e) {
+            std::cerr << "Passthrough unavailable: " << e.what() << std::endl;
         }
     }
 
-    // Processes single character input
+    // True when some output stage has to see shell bytes in user space,
+    // which rules out splicing them straight to stdout
+    bool outputNeedsCopy() const {
+        return screen_ != nullptr;
+    }
+
+    // How long output may keep draining after the shell has been reaped
+    static constexpr int kExitGraceMs = 200;
+    // Maximum reads per handler call before yielding to other descriptors
+    static constexpr int kReadBudget = 64;
+    // Starting size of the shell output buffer; one PTY read rarely exceeds a page
+    static constexpr size_t kMinReadBuffer = 4096;
+
+    // Reads and processes user input until stdin would block
+    bool readUserInput() {
+        for (int round = 0; round < kReadBudget && is_running_; ++round) {
+            ssize_t bytes_read = read(STDIN_FILENO, buffer_, sizeof(buffer_));
+            if (bytes_read == -1) {
+                if (errno == EINTR) continue;
+                return true;
+            }
+            if (bytes_read == 0) {
+                is_running_ = false;
+                return true;
+            }
+
+            size_t count = static_cast<size_t>(bytes_read);
+            if (renderer_) input_deadline_ = std::chrono::steady_clock::now() + frame_interval_;
+            for (size_t i = 0; i < count;) {
+                // Outside escape sequences, printable runs are forwarded in one step
+                if (escape_sequence_.empty()) {
+                    size_t run = textRun(buffer_ + i, count - i);
+                    if (run > 0) {
+                        forwardPrintable(buffer_ + i, run);
+                        i += run;
+                        continue;
+                    }
+                }
+                if (!processInput(buffer_[i++])) {
+                    is_running_ = false;
+                    break;
+                }
+            }
+        }
+        return !is_running_;
+    }
+
+    // Echoes and forwards a run of ordinary characters with one append per fd
+    void forwardPrintable(const char* data, size_t count) {
+        if (searching_) {
+            search_query_.append(data, count);
+            if (fuzzy_) {
+                startFuzzy();
+            } else {
+                // The match shown stays if it still matches
+                startSearch(search_match_ ? history_ranking_.prev(search_match_) : nullptr);
+            }
+            return;
+        }
+        input_buffer_.append(data, count);
+        echo(data, count);
+        output_.queue(master_fd_, data, count);
+    }
+
+    // Shows locally echoed input. The screen model sees it like shell output,
+    // with the newline translation the host's tty would apply; with the
+    // renderer it reaches the host only through the next frame.
+    void echo(const char* data, size_t count) {
+        if (screen_) {
+            for (size_t i = 0; i < count;) {
+                const char* newline = static_cast<const char*>(std::memchr(data + i, '\n', count - i));
+                size_t end = newline ? static_cast<size_t>(newline - data) : count;
+                observeShellOutput(data + i, end - i);
+                if (!newline) break;
+                observeShellOutput("\r\n", 2);
+                i = end + 1;
+            }
+        }
+        if (!renderer_) output_.queue(STDOUT_FILENO, data, count);
+    }
+
+    // Creates the (disarmed) timer that paces frames under --max-fps
+    void startFrameTimer() {
+        frame_pending_ = true; // The first frame clears the host screen
+        if (options_.max_fps <= 0) return;
+        frame_interval_ = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+            std::chrono::seconds(1)) / options_.max_fps;
+        frame_timer_ = loop_->addTimer(0, 0, [this] { frame_timer_armed_ = false; });
+    }
+
+    // Presents pending changes at most once per frame interval. A flood of
+    // output is parsed into the model at full speed while the host sees
+    // only the frames in between; right after a keystroke, frames go out
+    // at once so echo and the program's reaction are not delayed.
+    void scheduleFrame() {
+        if (!frame_pending_) return;
+        auto now = std::chrono::steady_clock::now();
+        if (now < input_deadline_ || now - last_frame_ >= frame_interval_) {
+            if (frame_timer_armed_) {
+                loop_->armTimer(frame_timer_, 0, 0);
+                frame_timer_armed_ = false;
+            }
+            presentFrame();
+            return;
+        }
+        if (frame_timer_armed_) return;
+        auto wait = std::chrono::duration_cast<std::chrono::milliseconds>(frame_interval_ - (now - last_frame_));
+        loop_->armTimer(frame_timer_, static_cast<int>(wait.count()) + 1, 0);
+        frame_timer_armed_ = true;
+    }
+
+    // Sends the host what changed since the last frame. While stdout is
+    // still busy with earlier output no frame is built, so changes coalesce.
+    void presentFrame() {
+        if (output_.blocked(STDOUT_FILENO)) return;
+        frame_.clear();
+        renderer_->render(*screen_, frame_);
+        frame_pending_ = false;
+        last_frame_ = std::chrono::steady_clock::now();
+        if (frame_.empty()) return;
+        ++stats_.frames;
+        stats_.frame_bytes += frame_.size();
+        output_.queue(STDOUT_FILENO, frame_.data(), frame_.size());
+    }
+
+    // Reads and forwards shell output to stdout until the PTY would block.
+    // Each PTY read returns at most a few KB, so reads are gathered into the
+    // adaptive buffer and flushed with one write when it fills or drains.
+    bool readShellOutput(uint32_t events) {
+        size_t filled = 0;
+        bool drained = false;
+        bool closed = false;
+
+        for (int round = 0; round < kReadBudget && filled < output_buffer_.capacity(); ++round) {
+            ssize_t bytes_read = read(master_fd_, output_buffer_.data() + filled,
+                                      output_buffer_.capacity() - filled);
+            if (bytes_read > 0) {
+                filled += bytes_read;
+                ++stats_.output_reads;
+                continue;
+            }
+            if (bytes_read == -1 && errno == EINTR) continue;
+            if (bytes_read == -1 && errno == EAGAIN && !(events & kHangup)) {
+                drained = true;
+            } else {
+                closed = true; // EOF or EIO: the slave side is closed, so the shell has exited
+            }
+            break;
+        }
+
+        if (filled > 0) {
+            forwardShellOutput(output_buffer_.data(), filled);
+            ++stats_.output_wakeups;
+            stats_.output_bytes += filled;
+        }
+        output_buffer_.record(filled);
+
+        if (closed) {
+            loop_->remove(master_fd_);
+            is_running_ = false;
+            return true;
+        }
+        return drained;
+    }
+
+    // Queues shell output for stdout and flushes it, joining any queued echo.
+    // The caller may reuse data afterwards: a blocked remainder is copied.
+    void forwardShellOutput(const char* data, size_t count) {
+        observeShellOutput(data, count);
+        if (renderer_) return; // Reaches the host through presentFrame
+        if (output_.blocked(STDOUT_FILENO)) {
+            output_.queue(STDOUT_FILENO, data, count);
+            return;
+        }
+        uint64_t calls = output_.writeCalls();
+        output_.queueRef(STDOUT_FILENO, data, count);
+        flushOutput(STDOUT_FILENO);
+        stats_.output_writes += output_.writeCalls() - calls;
+    }
+
+    // Updates the screen model, when there is one, and follows the terminal
+    // modes the shell sets that change how keys are routed. With the renderer,
+    // sequences the model does not draw but the host must see are handed to it
+    // for passthrough.
+    struct OutputActions : VtHandler {
+        TerminalEmulator& terminal;
+        Screen* screen;
+        Renderer* renderer;
+
+        explicit OutputActions(TerminalEmulator& owner)
+            : terminal(owner), screen(owner.screen_.get()), renderer(owner.renderer_.get()) {}
+
+        void print(const char* data, size_t count) {
+            if (screen) screen->print(data, count);
+        }
+
+        void execute(unsigned char c) {
+            if (screen) screen->execute(c);
+            if (renderer && c == '\a') renderer->passthrough("\a", 1);
+        }
+
+        void escDispatch(const VtSequence& seq) {
+            if (screen) screen->escDispatch(seq);
+            if (seq.final == 'c' && seq.intermediate_count == 0) { // RIS
+                terminal.application_cursor_ = false;
+                terminal.alternate_screen_ = false;
+            }
+            if (renderer && seq.intermediate_count == 0 && (seq.final == '=' || seq.final == '>')) {
+                char keypad[2] = {'\x1B', seq.final}; // DECKPAM, DECKPNM
+                renderer->passthrough(keypad, 2);
+            }
+        }
+
+        void csiDispatch(const VtSequence& seq) {
+            if (screen) screen->csiDispatch(seq);
+            if (renderer && hostOnly(seq)) {
+                std::string csi;
+                appendCsi(seq, csi);
+                renderer->passthrough(csi.data(), csi.size());
+            }
+            if (seq.final == 'p' && seq.hasIntermediates("!")) { // DECSTR
+                terminal.application_cursor_ = false;
+                return;
+            }
+            if ((seq.final != 'h' && seq.final != 'l') || !seq.hasIntermediates("?")) return;
+            bool set = seq.final == 'h';
+            for (size_t i = 0; i < seq.param_count; ++i) {
+                switch (seq.params[i]) {
+                case 1:
+                    terminal.application_cursor_ = set;
+                    break;
+                case 47:
+                case 1047:
+                case 1049:
+                    terminal.alternate_screen_ = set;
+                    break;
+                }
+                // The host reads keys and the mouse, so it has to know their modes
+                if (renderer && !screenMode(seq.params[i])) {
+                    std::string mode = "\x1B[?" + std::to_string(seq.params[i]) + seq.final;
+                    renderer->passthrough(mode.data(), mode.size());
+                }
+            }
+        }
+
+        void oscDispatch(const char* data, size_t count) {
+            if (screen) screen->oscDispatch(data, count);
+            // Titles, colours and clipboard go to the host; hyperlinks (OSC 8)
+            // are drawn by the renderer along with the cells they cover
+            if (!renderer || (count >= 2 && data[0] == '8' && data[1] == ';')) return;
+            renderer->passthrough("\x1B]", 2);
+            renderer->passthrough(data, count);
+            renderer->passthrough("\x1B\\", 2);
+        }
+
+        // DCS strings (capability and setting queries, sixel, tmux
+        // passthrough) go to the host whole, so no frame lands inside one
+        void hook(const VtSequence& seq) {
+            if (!renderer) return;
+            terminal.dcs_.clear();
+            appendCsi(seq, terminal.dcs_, 'P');
+        }
+
+        void put(const char* data, size_t count) {
+            if (renderer) terminal.dcs_.append(data, count);
+        }
+
+        void unhook() {
+            if (!renderer) return;
+            terminal.dcs_ += "\x1B\\";
+            renderer->passthrough(terminal.dcs_.data(), terminal.dcs_.size());
+            terminal.dcs_.clear();
+        }
+
+        // Private modes the screen model implements and the renderer presents
+        static bool screenMode(unsigned mode) {
+            return mode == 6 || mode == 7 || mode == 25 || mode == 47 || mode == 1047 || mode == 1049;
+        }
+
+        // Reports, queries and host settings: DSR, DA, window ops, cursor
+        // style, and keyboard protocol changes
+        static bool hostOnly(const VtSequence& seq) {
+            switch (seq.final) {
+            case 'n':
+            case 'c':
+                return seq.intermediate_count == 0 || seq.hasIntermediates("?") || seq.hasIntermediates(">") ||
+                       seq.hasIntermediates("=");
+            case 't':
+                return seq.intermediate_count == 0;
+            case 'q':
+                return seq.hasIntermediates(" ");
+            case 'm':
+                return seq.hasIntermediates(">");
+            case 'u':
+                return seq.hasIntermediates(">") || seq.hasIntermediates("<") || seq.hasIntermediates("=") ||
+                       seq.hasIntermediates("?");
+            }
+            return false;
+        }
+
+        // Re-encodes a dispatched CSI sequence, or with introducer 'P' a DCS
+        // header: private marker, parameters, then intermediates
+        static void appendCsi(const VtSequence& seq, std::string& out, char introducer = '[') {
+            out += '\x1B';
+            out += introducer;
+            for (size_t i = 0; i < seq.intermediate_count; ++i) {
+                if (seq.intermediates[i] >= 0x3C) out += seq.intermediates[i];
+            }
+            for (size_t i = 0; i < seq.param_count; ++i) {
+                if (i > 0) out += (seq.subparams >> i & 1) ? ':' : ';';
+                out += std::to_string(seq.params[i]);
+            }
+            for (size_t i = 0; i < seq.intermediate_count; ++i) {
+                if (seq.intermediates[i] < 0x3C) out += seq.intermediates[i];
+            }
+            out += seq.final;
+        }
+    };
+
+    // Runs shell output through the parser; bytes spliced by --passthrough are not seen
+    void observeShellOutput(const char* data, size_t count) {
+        OutputActions actions(*this);
+        output_parser_.feed(data, count, actions);
+        frame_pending_ = true;
+    }
+
+    // Splices shell output to stdout through the kernel pipe, with no user-space copy
+    bool spliceShellOutput(uint32_t events) {
+        size_t moved = 0;
+        bool drained = false;
+        bool closed = false;
+
+        for (int round = 0; round < kReadBudget && !splice_->full(); ++round) {
+            ssize_t spliced = splice_->fill(master_fd_);
+            if (spliced > 0) {
+                moved += spliced;
+                ++stats_.output_reads;
+                continue;
+            }
+            if (spliced == -1 && errno == EINTR) continue;
+            if (spliced == -1 && errno == EINVAL) {
+                // The kernel can't splice these descriptors; use the copy path from now on
+                splice_broken_ = true;
+                if (moved > 0) break;
+                return readShellOutput(events);
+            }
+            if (spliced == -1 && errno == EAGAIN && !(events & kHangup)) {
+                drained = true;
+            } else {
+                closed = true;
+            }
+            break;
+        }
+
+        if (moved > 0) {
+            flushSplicePipe();
+            ++stats_.output_wakeups;
+            stats_.output_bytes += moved;
+        }
+
+        if (closed) {
+            loop_->remove(master_fd_);
+            is_running_ = false;
+            return true;
+        }
+        return drained;
+    }
+
+    // Moves the splice pipe into stdout until it empties or stdout would block
+    void flushSplicePipe() {
+        // Queued echo precedes the spliced output
+        if (output_.flush(STDOUT_FILENO) != FlushResult::kFlushed) {
+            watchStdout(true);
+            return;
+        }
+        while (splice_->buffered() > 0) {
+            ssize_t spliced = splice_->drain(STDOUT_FILENO);
+            if (spliced > 0) {
+                ++stats_.output_writes;
+                continue;
+            }
+            if (spliced == -1 && errno == EINTR) continue;
+            if (spliced == -1 && errno == EAGAIN) {
+                watchStdout(true);
+                return;
+            }
+            std::cerr << "Write error: " << std::strerror(errno) << std::endl;
+            break;
+        }
+        if (splice_broken_) splice_.reset();
+        watchStdout(false);
+    }
+
+    // Routes parsed keystrokes to the line editor and the shell
+    struct KeyActions : VtHandler {
+        TerminalEmulator& terminal;
+        bool keep_running = true;
+
+        explicit KeyActions(TerminalEmulator& owner) : terminal(owner) {}
+
+        void print(const char* data, size_t count) { terminal.forwardPrintable(data, count); }
+        void execute(unsigned char c) { keep_running = terminal.handleControl(static_cast<char>(c)); }
+
+        void escDispatch(const VtSequence& seq) {
+            // SS3 keys (ESC O A) are completed by the next byte, which the
+            // parser would otherwise print
+            if (seq.final == 'O' && seq.intermediate_count == 0) terminal.ss3_pending_ = true;
+        }
+
+        void csiDispatch(const VtSequence& seq) {
+            if (seq.param_count == 0 && seq.intermediate_count == 0) terminal.handleArrowKey(seq.final);
+        }
+    };
+
+    // Processes single character input. Escape sequences are collected raw
+    // and forwarded to the shell unchanged once the parser completes them.
     bool processInput(char c) {
-        static std::string escape_sequence;
+        if (ss3_pending_) {
+            ss3_pending_ = false;
+            escape_sequence_ += c;
+            handleArrowKey(c);
+            forwardKeySequence();
+            return true;
+        }
 
+        bool in_sequence = input_parser_.state() != VtState::kGround || c == 27;
+        if (in_sequence) escape_sequence_ += c;
+        KeyActions actions(*this);
+        input_parser_.advance(static_cast<unsigned char>(c), actions);
+        if (in_sequence && input_parser_.state() == VtState::kGround && !ss3_pending_) {
+            forwardKeySequence();
+        }
+        return actions.keep_running;
+    }
+
+    void forwardKeySequence() {
+        output_.queue(master_fd_, escape_sequence_);
+        escape_sequence_.clear();
+    }
+
+    // Handles a control character, including one embedded in a key sequence
+    bool handleControl(char c) {
+        if (!escape_sequence_.empty()) {
+            escape_sequence_.pop_back();
+            if (c == 24 || c == 26) escape_sequence_.clear(); // CAN and SUB abort the sequence
+        }
+        if (searching_ && handleSearchControl(c)) return true;
+        if (c == 18 && !application_cursor_ && !alternate_screen_) { // Ctrl+R
+            searching_ = true;
+            fuzzy_ = false;
+            search_query_.clear();
+            search_match_ = nullptr;
+            displaySearch();
+            return true;
+        }
         if (c == 3) { // Ctrl+C
             return sendSignalToChild(SIGINT);
         }
@@ -215,23 +1115,18 @@ private:
             return sendSignalToChild(SIGTSTP);
         }
         if (c == 4) { // Ctrl+D
-            safeWrite(master_fd_, &c, 1);
+            output_.queue(master_fd_, &c, 1);
             is_running_ = false;
             return false;
         }
         if (c == 127) { // Backspace
             return handleBackspace();
         }
-        if (handleEscapeSequence(c, escape_sequence)) {
-            return true;
-        }
         if (c == '\r' || c == '\n') {
             return handleEnter();
         }
 
-        input_buffer_ += c;
-        safeWrite(STDOUT_FILENO, &c, 1);
-        safeWrite(master_fd_, &c, 1);
+        forwardPrintable(&c, 1);
         return true;
     }
 
@@ -242,103 +1137,368 @@ private:
             return false;
         }
 
-        if (!input_buffer_.empty()) {
-            history_.push_back(input_buffer_);
-            history_index_ = history_.size();
+        if (!input_buffer_.empty() && !readingSecret()) {
+            int64_t now = time(nullptr);
+            history_.append(input_buffer_, now);
+            std::string_view stored;
+            history_.entry(0, stored);
+            history_ranking_.use(stored, now);
         }
+        history_cursor_ = nullptr;
         input_buffer_.clear();
 
-        safeWrite(master_fd_, "\n", 1);
-        safeWrite(STDOUT_FILENO, "\n", 1);
+        output_.queue(master_fd_, "\n", 1);
+        echo("\n", 1);
         return true;
     }
 
+    // Whether the shell tty reads a line without echoing it, as password
+    // prompts do; such lines stay out of the history. Line editors such as
+    // readline turn echo off too, but also leave canonical mode. Unknown
+    // counts as secret.
+    bool readingSecret() const {
+        struct termios tty;
+        if (tcgetattr(master_fd_, &tty) == -1) return true;
+        return !(tty.c_lflag & ECHO) && (tty.c_lflag & ICANON);
+    }
+
     // Handles backspace key
     bool handleBackspace() {
         if (input_buffer_.empty()) return true;
         input_buffer_.pop_back();
-        safeWrite(STDOUT_FILENO, "\b \b", 3);
-        safeWrite(master_fd_, "\b", 1);
+        echo("\b \b", 3);
+        output_.queue(master_fd_, "\b", 1);
         return true;
     }
 
-    // Processes escape sequences (e.g., arrow keys)
-    bool handleEscapeSequence(char c, std::string& sequence) {
-        if (c == 27) { // Escape key
-            sequence = "\033";
-            return true;
+    // Handles arrow key navigation in command history. Full-screen programs
+    // that take over the cursor keys get them untouched. Up and Down walk
+    // the ranking, whose order is not the shell's own, so the shell gets the
+    // entry in place of the key.
+    void handleArrowKey(char c) {
+        if (application_cursor_ || alternate_screen_) return;
+        if (searching_) acceptSearch();
+        if (c == 'A') { // Up arrow
+            escape_sequence_.clear();
+            const HistoryRanking::Entry* next =
+                history_cursor_ ? history_ranking_.next(history_cursor_) : history_ranking_.first();
+            if (!next) return;
+            history_cursor_ = next;
+            displayHistoryEntry();
+        } else if (c == 'B') { // Down arrow
+            escape_sequence_.clear();
+            if (history_cursor_) history_cursor_ = history_ranking_.prev(history_cursor_);
+            displayHistoryEntry();
         }
+    }
 
-        if (!sequence.empty()) {
-            sequence += c;
-            if (sequence.size() == 2 && c != '[') {
-                safeWrite(master_fd_, sequence.c_str(), sequence.size());
-                sequence.clear();
-                return true;
+    // Displays the current history entry, or an empty line past the first
+    void displayHistoryEntry() {
+        replaceInput(history_cursor_ ? history_cursor_->text : std::string_view());
+        displayInputLine();
+    }
+
+    // Replaces the line being typed, at the shell too, with text. The old
+    // line goes with the tty's kill character, which the kernel and line
+    // editors take as erasing it whole, whatever the shell's encoding.
+    void replaceInput(std::string_view text) {
+        if (!input_buffer_.empty()) {
+            char kill = killChar();
+            output_.queue(master_fd_, &kill, 1);
+        }
+        output_.queue(master_fd_, text.data(), text.size());
+        input_buffer_.assign(text.data(), text.size()); // Reuses the buffer's capacity
+    }
+
+    // The shell tty's VKILL, Ctrl+U if it has none
+    char killChar() const {
+        struct termios tty;
+        if (tcgetattr(master_fd_, &tty) == 0 && tty.c_cc[VKILL] != _POSIX_VDISABLE) {
+            return static_cast<char>(tty.c_cc[VKILL]);
+        }
+        return '\x15';
+    }
+
+    // Handles a control character typed at the search prompt; returns false
+    // for one that ends the search and is then handled as usual
+    bool handleSearchControl(char c) {
+        if (c == 18) { // Ctrl+R: next match down the ranking, or next fuzzy result
+            if (fuzzy_) {
+                if (fuzzy_rank_ + 1 < finder_->results().size()) ++fuzzy_rank_;
+                showFuzzyResult();
+            } else if (!search_query_.empty() && search_match_) {
+                startSearch(search_match_);
             }
-            if (sequence.size() == 3) {
-                handleArrowKey(sequence[2]);
-                safeWrite(master_fd_, sequence.c_str(), sequence.size());
-                sequence.clear();
-                return true;
+            return true;
+        }
+        if (c == 127 || c == '\t') {
+            if (c == '\t') {
+                fuzzy_ = !fuzzy_;
+            } else if (!search_query_.empty()) {
+                search_query_.pop_back();
             }
+            search_match_ = nullptr;
+            if (fuzzy_) {
+                startFuzzy();
+            } else {
+                if (finder_) finder_->cancel();
+                startSearch(nullptr);
+            }
+            return true;
+        }
+        if (c == 7) { // Ctrl+G: leave the line as it was
+            endSearch();
+            displayInputLine();
+            return true;
         }
+        acceptSearch();
         return false;
     }
 
-    // Handles arrow key navigation in command history
-    void handleArrowKey(char c) {
-        if (c == 'A' && history_index_ > 0) { // Up arrow
-            --history_index_;
-            displayHistoryEntry();
-        } else if (c == 'B') { // Down arrow
-            if (history_index_ + 1 < history_.size()) {
-                ++history_index_;
-                displayHistoryEntry();
-            } else {
-                history_index_ = history_.size();
-                input_buffer_.clear();
-                displayHistoryEntry();
+    // Searches for search_query_ among the entries ranked after cursor (from
+    // the first when null); an empty query matches nothing
+    void startSearch(const HistoryRanking::Entry* cursor) {
+        search_cursor_ = cursor;
+        search_pending_ = !search_query_.empty();
+        if (search_pending_) {
+            continueSearch();
+        } else {
+            search_match_ = nullptr;
+            displaySearch();
+        }
+    }
+
+    // Ranks history against the query on the finder's workers. The prompt
+    // shows the best result so far and is redrawn as shards finish.
+    void startFuzzy() {
+        if (!finder_) {
+            try {
+                finder_ = std::make_unique<FuzzyFinder>(history_ranking_);
+            } catch (const std::exception& e) {
+                std::cerr << "Fuzzy search unavailable: " << e.what() << std::endl;
+                fuzzy_ = false;
+                startSearch(nullptr);
+                return;
             }
+            loop_->add(finder_->notifyFd(), kReadable, [this](uint32_t) {
+                bool changed = finder_->collect();
+                if (searching_ && fuzzy_ && (changed || finder_->done())) showFuzzyResult();
+                return true;
+            });
         }
+        finder_->start(search_query_);
+        fuzzy_rank_ = 0;
+        showFuzzyResult();
     }
 
-    // Displays the current history entry
-    void displayHistoryEntry() {
+    void showFuzzyResult() {
+        const std::vector<FuzzyFinder::Result>& results = finder_->results();
+        fuzzy_rank_ = std::min(fuzzy_rank_, results.empty() ? 0 : results.size() - 1);
+        search_match_ = results.empty() ? nullptr : results[fuzzy_rank_].entry;
+        displaySearch();
+    }
+
+    // Runs the search a bounded step further. The prompt keeps the previous
+    // match until the step that settles the result.
+    void continueSearch() {
+        HistorySearch::Result result = history_search_.find(search_query_, search_cursor_);
+        if (result == HistorySearch::Result::kPending) return;
+        search_pending_ = false;
+        search_match_ = result == HistorySearch::Result::kFound ? search_cursor_ : nullptr;
+        displaySearch();
+    }
+
+    // Shows the search prompt with the query and the matching entry
+    void displaySearch() {
         clearLine();
-        std::string prompt = "$ ";
-        safeWrite(STDOUT_FILENO, prompt.c_str(), prompt.size());
+        bool failed = !search_match_ && !search_query_.empty() && (!fuzzy_ || finder_->done());
+        std::string line = failed ? "(failed " : "(";
+        line += fuzzy_ ? "fuzzy-search)`" : "reverse-i-search)`";
+        line += search_query_;
+        line += "': ";
+        if (search_match_) line.append(search_match_->text.data(), search_match_->text.size());
+        echo(line.c_str(), line.size());
+    }
+
+    // Leaves the search, replacing the shell's input line with the match
+    void acceptSearch() {
+        endSearch();
+        if (search_match_) {
+            replaceInput(search_match_->text);
+            history_cursor_ = search_match_; // Arrows continue from the match
+        }
+        displayInputLine();
+    }
 
-        input_buffer_ = (history_index_ < history_.size()) ? history_[history_index_] : "";
-        safeWrite(STDOUT_FILENO, input_buffer_.c_str(), input_buffer_.size());
+    void endSearch() {
+        searching_ = search_pending_ = false;
+        if (finder_) finder_->cancel();
+    }
+
+    // Redraws the prompt and the input line
+    void displayInputLine() {
+        clearLine();
+        std::string prompt = "$ ";
+        echo(prompt.c_str(), prompt.size());
+        echo(input_buffer_.c_str(), input_buffer_.size());
     }
 
     // Sends a signal to the child process
     bool sendSignalToChild(int signal) {
         if (child_pid_ <= 0) return true;
+        if (signal == SIGINT || signal == SIGTERM || signal == SIGKILL) {
+            // The loop ends once the shell is reaped
+            return terminateChild(signal);
+        }
         if (kill(child_pid_, signal) == -1) {
             std::cerr << "Failed to send signal to child: " << std::strerror(errno) << std::endl;
             return false;
         }
-        if (signal == SIGINT || signal == SIGTERM || signal == SIGKILL) {
-            waitpid(child_pid_, nullptr, 0);
-            child_pid_ = -1;
-            is_running_ = false;
-        }
         return true;
     }
 
     // Clears the current input line
     void clearLine() {
-        safeWrite(STDOUT_FILENO, "\r\x1B[K", 4);
+        echo("\r\x1B[K", 4);
     }
 };
 
-TerminalEmulator* TerminalEmulator::instance_ = nullptr;
+// Largest byte count a size option takes; keeps arithmetic on it from overflowing
+static constexpr unsigned long long kMaxSizeOption = 1ull << 40;
+
+// Parses a numeric option argument, exiting unless it is a whole decimal
+// number from min to max. strtoull accepts a sign and wraps negative
+// values around, so only digits are allowed.
+static unsigned long long parseNumber(const char* arg, unsigned long long min, unsigned long long max,
+                                      const char* what, const char* expected) {
+    char* end;
+    errno = 0;
+    unsigned long long value = std::strtoull(arg, &end, 10);
+    if (!std::isdigit(static_cast<unsigned char>(arg[0])) || *end != '\0' || errno == ERANGE || value < min ||
+        value > max) {
+        std::cerr << "Invalid " << what << ": " << arg << " (expected " << expected << ")" << std::endl;
+        exit(2);
+    }
+    return value;
+}
+
+// Parses command-line flags into Options, exiting on --help or bad input
+static Options parseOptions(int argc, char* argv[]) {
+    static const struct option long_options[] = {
+        {"event-loop", required_argument, nullptr, 'e'},
+        {"io-uring", no_argument, nullptr, 'u'},
+        {"max-read-buffer", required_argument, nullptr, 'b'},
+        {"stats", no_argument, nullptr, 's'},
+        {"passthrough", no_argument, nullptr, 'p'},
+        {"output-queue-limit", required_argument, nullptr, 'q'},
+        {"overflow", required_argument, nullptr, 'o'},
+        {"threaded", no_argument, nullptr, 't'},
+        {"reader-ring-size", required_argument, nullptr, 'r'},
+        {"kill-timeout", required_argument, nullptr, 'k'},
+        {"screen-model", no_argument, nullptr, 'm'},
+        {"scrollback-limit", required_argument, nullptr, 'l'},
+        {"diff-render", no_argument, nullptr, 'd'},
+        {"max-fps", required_argument, nullptr, 'f'},
+        {"history-file", required_argument, nullptr, 'H'},
+        {"help", no_argument, nullptr, 'h'},
+        {nullptr, 0, nullptr, 0}
+    };
+
+    Options options;
+    if (const char* home = getenv("HOME")) options.history_file = std::string(home) + "/.terminal_emulator_history";
+    int opt;
+    while ((opt = getopt_long(argc, argv, "e:ub:spq:o:tr:k:ml:df:H:h", long_options, nullptr)) != -1) {
+        switch (opt) {
+        case 'e':
+            options.event_loop = optarg;
+            break;
+        case 'u':
+            options.io_uring = true;
+            break;
+        case 'b':
+            options.max_read_buffer = parseNumber(optarg, 1, kMaxSizeOption, "read buffer size", "1 to 2^40 bytes");
+            break;
+        case 's':
+            options.stats = true;
+            break;
+        case 'p':
+            options.passthrough = true;
+            break;
+        case 'q':
+            options.output_queue_limit =
+                parseNumber(optarg, 1, kMaxSizeOption, "output queue limit", "1 to 2^40 bytes");
+            break;
+        case 'o':
+            if (std::strcmp(optarg, "block") == 0) {
+                options.overflow = OverflowPolicy::kBlock;
+            } else if (std::strcmp(optarg, "drop") == 0) {
+                options.overflow = OverflowPolicy::kDrop;
+            } else if (std::strcmp(optarg, "spill") == 0) {
+                options.overflow = OverflowPolicy::kSpill;
+            } else {
+                std::cerr << "Unknown overflow policy: " << optarg << std::endl;
+                exit(2);
+            }
+            break;
+        case 't':
+            options.threaded = true;
+            break;
+        case 'r':
+            // The ring is allocated whole, rounded up to a power of two
+            options.reader_ring_size = parseNumber(optarg, 1, 1ull << 30, "reader ring size", "1 to 2^30 bytes");
+            break;
+        case 'k':
+            // 0 would arm no escalation timer at all, so SIGKILL never followed
+            options.kill_timeout_ms =
+                static_cast<int>(parseNumber(optarg, 1, INT_MAX, "kill timeout", "milliseconds > 0"));
+            break;
+        case 'm':
+            options.screen_model = true;
+            break;
+        case 'l':
+            options.scrollback_limit =
+                parseNumber(optarg, 0, kMaxSizeOption, "scrollback limit", "0 to 2^40 bytes");
+            break;
+        case 'd':
+            options.diff_render = true;
+            options.screen_model = true;
+            break;
+        case 'f':
+            options.max_fps =
+                static_cast<int>(parseNumber(optarg, 0, 1000, "frame rate", "0 to 1000 frames per second"));
+            break;
+        case 'H':
+            options.history_file = optarg;
+            break;
+        case 'h':
+            std::cout << "Usage: " << argv[0] << " [options]\n"
+                      << "  -e, --event-loop=BACKEND  epoll (default) or poll\n"
+                      << "  -u, --io-uring            pump shell output through io_uring\n"
+                      << "  -b, --max-read-buffer=N   shell output buffer ceiling in bytes (default 262144)\n"
+                      << "  -s, --stats               print I/O statistics on exit\n"
+                      << "  -p, --passthrough         splice shell output to stdout without copying\n"
+                      << "  -q, --output-queue-limit=N  stdout backlog kept in memory (default 4194304)\n"
+                      << "  -o, --overflow=POLICY     block (default), drop or spill when the backlog is full\n"
+                      << "  -t, --threaded            drain the PTY on a dedicated reader thread\n"
+                      << "  -r, --reader-ring-size=N  bytes buffered for the reader thread (default 4194304)\n"
+                      << "  -k, --kill-timeout=MS     wait before escalating SIGINT/SIGTERM to SIGKILL (default 2000)\n"
+                      << "  -m, --screen-model        keep an in-memory model of the shell's screen\n"
+                      << "  -l, --scrollback-limit=N  scrollback memory budget in bytes, 0 for none (default 8388608)\n"
+                      << "  -d, --diff-render         draw the screen model on the host, sending only changes (implies -m)\n"
+                      << "  -f, --max-fps=N           frames per second the diff renderer sends at most, 0 for no cap (default 60)\n"
+                      << "  -H, --history-file=PATH   command history log, empty for none (default ~/.terminal_emulator_history)\n";
+            exit(0);
+        default:
+            exit(2);
+        }
+    }
+    return options;
+}
 
-int main() {
+int main(int argc, char* argv[]) {
+    Options options = parseOptions(argc, argv);
     try {
-        TerminalEmulator terminal;
+        TerminalEmulator terminal(options);
         terminal.run();
     } catch (const std::exception& e) {
         std::cerr << "Startup error: " << e.what() << std::endl;
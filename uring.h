@@ -0,0 +1,426 @@
+#pragma once
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+// Minimal io_uring wrapper over the raw syscalls (liburing is not required)
+class IoUring {
+public:
+    // IORING_OP_READ_MULTISHOT (Linux 6.7); older UAPI headers lack the enum value
+    static constexpr uint8_t kOpReadMultishot = 49;
+
+    explicit IoUring(unsigned entries) {
+        struct io_uring_params params = {};
+        fd_ = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+        if (fd_ == -1) {
+            throw std::runtime_error("io_uring_setup failed: " + std::string(std::strerror(errno)));
+        }
+
+        sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cq_ring_size_ = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+        single_mmap_ = params.features & IORING_FEAT_SINGLE_MMAP;
+        if (single_mmap_) {
+            sq_ring_size_ = cq_ring_size_ = std::max(sq_ring_size_, cq_ring_size_);
+        }
+
+        sq_ring_ = mapRegion(sq_ring_size_, IORING_OFF_SQ_RING);
+        cq_ring_ = single_mmap_ ? sq_ring_ : mapRegion(cq_ring_size_, IORING_OFF_CQ_RING);
+        sqes_size_ = params.sq_entries * sizeof(struct io_uring_sqe);
+        sqes_ = static_cast<struct io_uring_sqe*>(mapRegion(sqes_size_, IORING_OFF_SQES));
+
+        char* sq = static_cast<char*>(sq_ring_);
+        sq_head_ = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+        sq_tail_ = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+        sq_mask_ = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+        sq_entries_ = params.sq_entries;
+        sq_array_ = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+
+        char* cq = static_cast<char*>(cq_ring_);
+        cq_head_ = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+        cq_tail_ = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+        cq_mask_ = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+        cqes_ = reinterpret_cast<struct io_uring_cqe*>(cq + params.cq_off.cqes);
+
+        sqe_tail_ = sqe_head_ = *sq_tail_;
+    }
+
+    ~IoUring() { release(); }
+
+    IoUring(const IoUring&) = delete;
+    IoUring& operator=(const IoUring&) = delete;
+
+    int fd() const { return fd_; }
+
+    // Number of io_uring_enter calls issued so far
+    uint64_t enterCalls() const { return enter_calls_; }
+
+    // Returns a zeroed submission entry, or nullptr when the queue is full
+    struct io_uring_sqe* getSqe() {
+        unsigned head = __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE);
+        if (sqe_tail_ - head >= sq_entries_) return nullptr;
+        struct io_uring_sqe* sqe = &sqes_[sqe_tail_ & sq_mask_];
+        ++sqe_tail_;
+        std::memset(sqe, 0, sizeof(*sqe));
+        return sqe;
+    }
+
+    // Publishes queued entries and submits them with a single io_uring_enter
+    void submit() {
+        unsigned tail = *sq_tail_;
+        unsigned count = sqe_tail_ - sqe_head_;
+        if (count == 0) return;
+        for (; sqe_head_ != sqe_tail_; ++sqe_head_, ++tail) {
+            sq_array_[tail & sq_mask_] = sqe_head_ & sq_mask_;
+        }
+        __atomic_store_n(sq_tail_, tail, __ATOMIC_RELEASE);
+
+        while (true) {
+            ++enter_calls_;
+            long ret = syscall(__NR_io_uring_enter, fd_, count, 0, 0, nullptr, 0);
+            if (ret >= 0) return;
+            if (errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+                throw std::runtime_error("io_uring_enter failed: " + std::string(std::strerror(errno)));
+            }
+        }
+    }
+
+    // Invokes callback for every available completion and releases them
+    template <typename Callback>
+    unsigned reap(Callback callback) {
+        unsigned head = *cq_head_;
+        unsigned tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+        unsigned count = 0;
+        for (; head != tail; ++head, ++count) {
+            callback(cqes_[head & cq_mask_]);
+        }
+        __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+        return count;
+    }
+
+    // Checks whether the running kernel supports an opcode
+    bool supportsOp(uint8_t op) {
+        std::vector<char> storage(sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op));
+        auto* probe = reinterpret_cast<struct io_uring_probe*>(storage.data());
+        if (syscall(__NR_io_uring_register, fd_, IORING_REGISTER_PROBE, probe, 256) == -1) {
+            return false;
+        }
+        return op <= probe->last_op && (probe->ops[op].flags & IO_URING_OP_SUPPORTED);
+    }
+
+private:
+    // Maps a ring region; on failure releases the regions mapped before it
+    void* mapRegion(size_t size, uint64_t offset) {
+        void* ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, offset);
+        if (ptr == MAP_FAILED) {
+            int err = errno;
+            release();
+            throw std::runtime_error("io_uring mmap failed: " + std::string(std::strerror(err)));
+        }
+        return ptr;
+    }
+
+    void release() {
+        if (sqes_) munmap(sqes_, sqes_size_);
+        if (cq_ring_ && !single_mmap_) munmap(cq_ring_, cq_ring_size_);
+        if (sq_ring_) munmap(sq_ring_, sq_ring_size_);
+        sqes_ = nullptr;
+        cq_ring_ = sq_ring_ = nullptr;
+        if (fd_ != -1) close(fd_);
+        fd_ = -1;
+    }
+
+    int fd_ = -1;
+    bool single_mmap_ = false;
+    void* sq_ring_ = nullptr;
+    void* cq_ring_ = nullptr;
+    size_t sq_ring_size_ = 0;
+    size_t cq_ring_size_ = 0;
+    size_t sqes_size_ = 0;
+    struct io_uring_sqe* sqes_ = nullptr;
+
+    unsigned* sq_head_ = nullptr;
+    unsigned* sq_tail_ = nullptr;
+    unsigned* sq_array_ = nullptr;
+    unsigned sq_mask_ = 0;
+    unsigned sq_entries_ = 0;
+    unsigned sqe_head_ = 0; // First entry not yet published to the kernel
+    unsigned sqe_tail_ = 0; // Next entry handed out by getSqe
+
+    unsigned* cq_head_ = nullptr;
+    unsigned* cq_tail_ = nullptr;
+    unsigned cq_mask_ = 0;
+    struct io_uring_cqe* cqes_ = nullptr;
+
+    uint64_t enter_calls_ = 0;
+};
+
+// Streams one descriptor into another through io_uring.
+//
+// A multishot read stays posted on the input and fills kernel-selected
+// provided buffers. Filled buffers are written out as a single chain of
+// IOSQE_IO_LINK writes, so ordering is preserved and a whole burst costs one
+// io_uring_enter. Written buffers are handed back with PROVIDE_BUFFERS in the
+// same submission; the legacy provided-buffer API is used rather than a
+// registered buffer ring because it works on every kernel with multishot reads.
+class UringPump {
+public:
+    UringPump(int in_fd, int out_fd) : ring_(kQueueDepth), in_fd_(in_fd), out_fd_(out_fd) {
+        if (!ring_.supportsOp(IoUring::kOpReadMultishot)) {
+            throw std::runtime_error("io_uring multishot read is not supported by this kernel");
+        }
+
+        pool_.resize(static_cast<size_t>(kBufferCount) * kBufferSize);
+        if (!provideBuffers(0, kBufferCount)) throw std::runtime_error("io_uring submission queue is full");
+        armRead();
+        ring_.submit();
+    }
+
+    UringPump(const UringPump&) = delete;
+    UringPump& operator=(const UringPump&) = delete;
+
+    // Completion queue descriptor; becomes readable when completions are posted
+    int fd() const { return ring_.fd(); }
+
+    bool inputClosed() const { return input_closed_; }
+    bool outputIdle() const { return queued_.empty() && !chain_active_; }
+    uint64_t bytesRead() const { return bytes_read_; }
+    uint64_t readCompletions() const { return read_completions_; }
+    uint64_t enterCalls() const { return ring_.enterCalls(); }
+
+    // Called with every chunk read, in order, before it is written out
+    void setObserver(std::function<void(const char*, size_t)> observer) {
+        observer_ = std::move(observer);
+    }
+
+    // Processes all completions and submits follow-up work; returns false on output failure
+    bool service() {
+        bool ok = true;
+        while (ring_.reap([&](const struct io_uring_cqe& cqe) { ok &= complete(cqe); }) > 0) {
+            submitPending();
+        }
+        return ok;
+    }
+
+    // Switches to single-shot reads once the input reports hangup. A posted
+    // multishot read on a PTY master is not completed by the slave closing, so
+    // the remaining data and the final EIO are collected with plain reads.
+    void notifyHangup() {
+        if (hangup_ || input_closed_) return;
+        hangup_ = true;
+        armRead();
+        ring_.submit();
+    }
+
+private:
+    static constexpr unsigned kQueueDepth = 256;
+    static constexpr unsigned kBufferCount = 64;
+    static constexpr unsigned kBufferSize = 16384;
+    static constexpr unsigned kMaxChain = 32;      // Writes per linked submission
+    static constexpr uint16_t kBufferGroup = 0;
+
+    enum Tag : uint64_t { kTagRead = 1, kTagWrite = 2, kTagPoll = 3, kTagProvide = 4 };
+
+    // A filled buffer, possibly partially written
+    struct Chunk {
+        uint16_t bid;
+        uint32_t offset;
+        uint32_t length;
+        int32_t result; // Completion result while part of an in-flight chain
+    };
+
+    static uint64_t encode(Tag tag, uint32_t index) { return (static_cast<uint64_t>(tag) << 32) | index; }
+
+    void submitPending() {
+        // Buffers whose return found the submission queue full go back first
+        while (!unprovided_.empty() && provideBuffers(unprovided_.back(), 1)) {
+            unprovided_.pop_back();
+            starved_ = false;
+        }
+        if (!chain_active_ && !poll_armed_ && !output_failed_) submitChain();
+        if (!read_armed_ && !input_closed_ && !starved_) armRead();
+        ring_.submit();
+    }
+
+    void armRead() {
+        struct io_uring_sqe* sqe = ring_.getSqe();
+        if (!sqe) return;
+        sqe->opcode = hangup_ ? static_cast<uint8_t>(IORING_OP_READ) : IoUring::kOpReadMultishot;
+        sqe->fd = in_fd_;
+        sqe->flags = IOSQE_BUFFER_SELECT;
+        sqe->buf_group = kBufferGroup;
+        sqe->user_data = encode(kTagRead, 0);
+        read_armed_ = true;
+    }
+
+    void armPoll() {
+        struct io_uring_sqe* sqe = ring_.getSqe();
+        if (!sqe) return;
+        sqe->opcode = IORING_OP_POLL_ADD;
+        sqe->fd = out_fd_;
+        sqe->poll32_events = POLLOUT;
+        sqe->user_data = encode(kTagPoll, 0);
+        poll_armed_ = true;
+    }
+
+    // Queues pending chunks as one ordered chain of linked writes
+    void submitChain() {
+        while (!queued_.empty() && inflight_.size() < kMaxChain) {
+            struct io_uring_sqe* sqe = ring_.getSqe();
+            if (!sqe) break;
+            Chunk chunk = queued_.front();
+            queued_.pop_front();
+            chunk.result = 0;
+
+            sqe->opcode = IORING_OP_WRITE;
+            sqe->fd = out_fd_;
+            sqe->addr = reinterpret_cast<uint64_t>(bufferAt(chunk.bid) + chunk.offset);
+            sqe->len = chunk.length;
+            sqe->off = static_cast<uint64_t>(-1); // Use and advance the file position
+            sqe->flags = IOSQE_IO_LINK;
+            sqe->user_data = encode(kTagWrite, static_cast<uint32_t>(inflight_.size()));
+            last_sqe_ = sqe;
+            inflight_.push_back(chunk);
+        }
+        if (inflight_.empty()) return;
+        last_sqe_->flags &= ~IOSQE_IO_LINK; // Terminate the chain
+        chain_active_ = true;
+        chain_remaining_ = inflight_.size();
+    }
+
+    bool complete(const struct io_uring_cqe& cqe) {
+        switch (static_cast<Tag>(cqe.user_data >> 32)) {
+        case kTagRead:
+            return completeRead(cqe);
+        case kTagWrite:
+            inflight_[cqe.user_data & 0xffffffffu].result = cqe.res;
+            if (--chain_remaining_ == 0) return finishChain();
+            return true;
+        case kTagPoll:
+            poll_armed_ = false;
+            return true;
+        case kTagProvide:
+            return true;
+        }
+        return true;
+    }
+
+    bool completeRead(const struct io_uring_cqe& cqe) {
+        if (!(cqe.flags & IORING_CQE_F_MORE)) read_armed_ = false;
+        if (cqe.flags & IORING_CQE_F_BUFFER) {
+            uint16_t bid = static_cast<uint16_t>(cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+            if (cqe.res <= 0) {
+                recycle(bid);
+            } else {
+                if (observer_) observer_(bufferAt(bid), static_cast<size_t>(cqe.res));
+                queued_.push_back({bid, 0, static_cast<uint32_t>(cqe.res), 0});
+                bytes_read_ += cqe.res;
+                ++read_completions_;
+                return true;
+            }
+        }
+        if (cqe.res == -ENOBUFS) {
+            starved_ = true; // Every buffer is queued for output; re-armed once one is recycled
+            return true;
+        }
+        if (cqe.res > 0 || cqe.res == -EINTR || cqe.res == -EAGAIN) return true;
+        input_closed_ = true; // EOF or EIO: the writer side went away
+        return true;
+    }
+
+    // Recycles written buffers and requeues, in order, anything the chain left behind
+    bool finishChain() {
+        std::vector<Chunk> leftovers;
+        bool blocked = false;
+        for (Chunk& chunk : inflight_) {
+            if (chunk.result == static_cast<int32_t>(chunk.length)) {
+                recycle(chunk.bid);
+                continue;
+            }
+            if (chunk.result > 0) {
+                chunk.offset += chunk.result;
+                chunk.length -= chunk.result;
+            } else if (chunk.result == -EAGAIN) {
+                blocked = true;
+            } else if (chunk.result != -ECANCELED && chunk.result != -EINTR) {
+                output_failed_ = true;
+            }
+            leftovers.push_back(chunk);
+        }
+        inflight_.clear();
+        chain_active_ = false;
+
+        if (output_failed_) {
+            for (const Chunk& chunk : leftovers) recycle(chunk.bid);
+            for (const Chunk& chunk : queued_) recycle(chunk.bid);
+            queued_.clear();
+            return false;
+        }
+        queued_.insert(queued_.begin(), leftovers.begin(), leftovers.end());
+        if (blocked) armPoll();
+        return true;
+    }
+
+    char* bufferAt(uint16_t bid) { return pool_.data() + static_cast<size_t>(bid) * kBufferSize; }
+
+    // Hands count consecutive buffers starting at bid to the kernel; returns
+    // false when the submission queue stays full even after submitting
+    bool provideBuffers(uint16_t bid, unsigned count) {
+        struct io_uring_sqe* sqe = ring_.getSqe();
+        if (!sqe) {
+            ring_.submit();
+            sqe = ring_.getSqe();
+            if (!sqe) return false;
+        }
+        sqe->opcode = IORING_OP_PROVIDE_BUFFERS;
+        sqe->fd = static_cast<int32_t>(count);
+        sqe->addr = reinterpret_cast<uint64_t>(bufferAt(bid));
+        sqe->len = kBufferSize;
+        sqe->off = bid;
+        sqe->buf_group = kBufferGroup;
+        sqe->user_data = encode(kTagProvide, 0);
+        return true;
+    }
+
+    // Returns a written buffer so the multishot read can fill it again
+    void recycle(uint16_t bid) {
+        if (!provideBuffers(bid, 1)) {
+            unprovided_.push_back(bid);
+            return;
+        }
+        starved_ = false;
+    }
+
+    IoUring ring_;
+    int in_fd_;
+    int out_fd_;
+    std::vector<char> pool_;
+
+    std::deque<Chunk> queued_;   // Read but not yet submitted for writing
+    std::vector<uint16_t> unprovided_; // Written buffers not yet handed back
+    std::vector<Chunk> inflight_;// Current linked write chain
+    struct io_uring_sqe* last_sqe_ = nullptr;
+    size_t chain_remaining_ = 0;
+    bool chain_active_ = false;
+    bool read_armed_ = false;
+    bool poll_armed_ = false;
+    bool input_closed_ = false;
+    bool starved_ = false;        // Multishot read stopped for lack of buffers
+    bool hangup_ = false;         // Input hung up; drain with single-shot reads
+    bool output_failed_ = false;
+
+    uint64_t bytes_read_ = 0;
+    uint64_t read_completions_ = 0;
+    std::function<void(const char*, size_t)> observer_;
+};
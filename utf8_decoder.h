@@ -0,0 +1,232 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "simd_scan.h"
+
+// Incremental UTF-8 decoder for PTY output.
+//
+// Runs of ASCII are widened 16 bytes at a time. Blocks containing multibyte
+// text are validated 32 bytes at a time with the Keiser-Lemire lookup
+// algorithm (AVX2) and, when valid, decoded without per-byte checks. Anything
+// else goes through a checked scalar decoder that replaces each maximal
+// invalid subpart with U+FFFD, as recommended by the Unicode standard. A
+// sequence split across reads is completed by the next call.
+class Utf8Decoder {
+public:
+    static constexpr char32_t kReplacement = 0xFFFD;
+
+    // Decodes count bytes into out, which must have room for count + 1
+    // codepoints, and returns how many were written
+    size_t decode(const char* data, size_t count, char32_t* out) {
+        const unsigned char* bytes = reinterpret_cast<const unsigned char*>(data);
+        size_t i = 0;
+        char32_t* end = out;
+
+        // Finish a sequence the previous chunk left open
+        while (need_ > 0 && i < count) end = step(bytes[i++], end);
+
+        while (i < count) {
+            size_t ascii = widenAscii(bytes + i, count - i, end);
+            i += ascii;
+            end += ascii;
+            if (i == count) break;
+#if defined(SIMD_SCAN_HAVE_AVX2)
+            if (count - i >= 32 && simd_scan::haveAvx2() && validBlock(bytes + i)) {
+                size_t length = 32 - openTail(bytes + i + 32);
+                end = decodeValid(bytes + i, length, end);
+                i += length;
+                continue;
+            }
+#endif
+            // Checked path: one sequence (or invalid subpart), then back to the fast paths
+            do {
+                end = step(bytes[i++], end);
+            } while (need_ > 0 && i < count);
+        }
+        return static_cast<size_t>(end - out);
+    }
+
+    // True while a multibyte sequence is waiting for its remaining bytes
+    bool pending() const { return need_ > 0; }
+
+private:
+    // Consumes one byte, following the well-formed byte sequences of Unicode Table 3-7
+    char32_t* step(unsigned char c, char32_t* out) {
+        if (need_ > 0) {
+            if (c >= lower_ && c <= upper_) {
+                codepoint_ = codepoint_ << 6 | (c & 0x3F);
+                lower_ = 0x80;
+                upper_ = 0xBF;
+                if (--need_ == 0) *out++ = codepoint_;
+                return out;
+            }
+            // The sequence so far is a maximal subpart; c starts afresh
+            *out++ = kReplacement;
+            need_ = 0;
+        }
+
+        lower_ = 0x80;
+        upper_ = 0xBF;
+        if (c < 0x80) {
+            *out++ = c;
+        } else if (c >= 0xC2 && c <= 0xDF) {
+            need_ = 1;
+            codepoint_ = c & 0x1F;
+        } else if (c >= 0xE0 && c <= 0xEF) {
+            need_ = 2;
+            codepoint_ = c & 0x0F;
+            if (c == 0xE0) lower_ = 0xA0;      // Overlong
+            else if (c == 0xED) upper_ = 0x9F; // Surrogates
+        } else if (c >= 0xF0 && c <= 0xF4) {
+            need_ = 3;
+            codepoint_ = c & 0x07;
+            if (c == 0xF0) lower_ = 0x90;      // Overlong
+            else if (c == 0xF4) upper_ = 0x8F; // Above U+10FFFF
+        } else {
+            *out++ = kReplacement;
+        }
+        return out;
+    }
+
+    // Widens the leading ASCII run into out, returning its length
+    static size_t widenAscii(const unsigned char* bytes, size_t count, char32_t* out) {
+        size_t i = 0;
+#if defined(__SSE2__)
+        const __m128i zero = _mm_setzero_si128();
+        for (; i + 16 <= count; i += 16) {
+            __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(bytes + i));
+            unsigned high = static_cast<unsigned>(_mm_movemask_epi8(chunk));
+            if (high) {
+                size_t run = __builtin_ctz(high);
+                for (size_t j = 0; j < run; ++j) out[i + j] = bytes[i + j];
+                return i + run;
+            }
+            __m128i lo16 = _mm_unpacklo_epi8(chunk, zero);
+            __m128i hi16 = _mm_unpackhi_epi8(chunk, zero);
+            __m128i* dst = reinterpret_cast<__m128i*>(out + i);
+            _mm_storeu_si128(dst + 0, _mm_unpacklo_epi16(lo16, zero));
+            _mm_storeu_si128(dst + 1, _mm_unpackhi_epi16(lo16, zero));
+            _mm_storeu_si128(dst + 2, _mm_unpacklo_epi16(hi16, zero));
+            _mm_storeu_si128(dst + 3, _mm_unpackhi_epi16(hi16, zero));
+        }
+#endif
+        for (; i < count && bytes[i] < 0x80; ++i) out[i] = bytes[i];
+        return i;
+    }
+
+    // Bytes at the end of a validated block that belong to a sequence it cuts off
+    static size_t openTail(const unsigned char* end) {
+        if (end[-1] >= 0xC0) return 1;
+        if (end[-2] >= 0xE0) return 2;
+        if (end[-3] >= 0xF0) return 3;
+        return 0;
+    }
+
+    // Decodes bytes already known to be well-formed UTF-8
+    static char32_t* decodeValid(const unsigned char* bytes, size_t count, char32_t* out) {
+        size_t i = 0;
+        while (i < count) {
+            unsigned char c = bytes[i];
+            if (c < 0x80) {
+                *out++ = c;
+                i += 1;
+            } else if (c < 0xE0) {
+                *out++ = (c & 0x1F) << 6 | (bytes[i + 1] & 0x3F);
+                i += 2;
+            } else if (c < 0xF0) {
+                *out++ = (c & 0x0F) << 12 | (bytes[i + 1] & 0x3F) << 6 | (bytes[i + 2] & 0x3F);
+                i += 3;
+            } else {
+                *out++ = (c & 0x07) << 18 | (bytes[i + 1] & 0x3F) << 12 |
+                         (bytes[i + 2] & 0x3F) << 6 | (bytes[i + 3] & 0x3F);
+                i += 4;
+            }
+        }
+        return out;
+    }
+
+#if defined(SIMD_SCAN_HAVE_AVX2)
+    // Keiser-Lemire validation of 32 bytes that start on a character
+    // boundary. A sequence cut off by the end of the block is not an error;
+    // the caller leaves it for the next block.
+    __attribute__((target("avx2")))
+    static bool validBlock(const unsigned char* bytes) {
+        constexpr uint8_t kTooShort = 1 << 0;
+        constexpr uint8_t kTooLong = 1 << 1;
+        constexpr uint8_t kOverlong3 = 1 << 2;
+        constexpr uint8_t kTooLarge = 1 << 3;
+        constexpr uint8_t kSurrogate = 1 << 4;
+        constexpr uint8_t kOverlong2 = 1 << 5;
+        constexpr uint8_t kTooLarge1000 = 1 << 6;
+        constexpr uint8_t kOverlong4 = 1 << 6;
+        constexpr uint8_t kTwoConts = 1 << 7;
+        constexpr uint8_t kCarry = kTooShort | kTooLong | kTwoConts;
+
+        const __m256i byte1_high_table = _mm256_setr_epi8(
+            kTooLong, kTooLong, kTooLong, kTooLong, kTooLong, kTooLong, kTooLong, kTooLong,
+            kTwoConts, kTwoConts, kTwoConts, kTwoConts,
+            kTooShort | kOverlong2, kTooShort, kTooShort | kOverlong3 | kSurrogate,
+            static_cast<char>(kTooShort | kTooLarge | kTooLarge1000 | kOverlong4),
+            kTooLong, kTooLong, kTooLong, kTooLong, kTooLong, kTooLong, kTooLong, kTooLong,
+            kTwoConts, kTwoConts, kTwoConts, kTwoConts,
+            kTooShort | kOverlong2, kTooShort, kTooShort | kOverlong3 | kSurrogate,
+            static_cast<char>(kTooShort | kTooLarge | kTooLarge1000 | kOverlong4));
+        const __m256i byte1_low_table = _mm256_setr_epi8(
+            kCarry | kOverlong3 | kOverlong2 | kOverlong4, kCarry | kOverlong2, kCarry, kCarry,
+            kCarry | kTooLarge, kCarry | kTooLarge | kTooLarge1000,
+            kCarry | kTooLarge | kTooLarge1000, kCarry | kTooLarge | kTooLarge1000,
+            kCarry | kTooLarge | kTooLarge1000, kCarry | kTooLarge | kTooLarge1000,
+            kCarry | kTooLarge | kTooLarge1000, kCarry | kTooLarge | kTooLarge1000,
+            kCarry | kTooLarge | kTooLarge1000, kCarry | kTooLarge | kTooLarge1000 | kSurrogate,
+            kCarry | kTooLarge | kTooLarge1000, kCarry | kTooLarge | kTooLarge1000,
+            kCarry | kOverlong3 | kOverlong2 | kOverlong4, kCarry | kOverlong2, kCarry, kCarry,
+            kCarry | kTooLarge, kCarry | kTooLarge | kTooLarge1000,
+            kCarry | kTooLarge | kTooLarge1000, kCarry | kTooLarge | kTooLarge1000,
+            kCarry | kTooLarge | kTooLarge1000, kCarry | kTooLarge | kTooLarge1000,
+            kCarry | kTooLarge | kTooLarge1000, kCarry | kTooLarge | kTooLarge1000,
+            kCarry | kTooLarge | kTooLarge1000, kCarry | kTooLarge | kTooLarge1000 | kSurrogate,
+            kCarry | kTooLarge | kTooLarge1000, kCarry | kTooLarge | kTooLarge1000);
+        constexpr char kCont1000 = static_cast<char>(kTooLong | kOverlong2 | kTwoConts | kOverlong3 |
+                                                     kTooLarge1000 | kOverlong4);
+        constexpr char kCont1001 = static_cast<char>(kTooLong | kOverlong2 | kTwoConts | kOverlong3 |
+                                                     kTooLarge);
+        constexpr char kCont101 = static_cast<char>(kTooLong | kOverlong2 | kTwoConts | kSurrogate |
+                                                    kTooLarge);
+        const __m256i byte2_high_table = _mm256_setr_epi8(
+            kTooShort, kTooShort, kTooShort, kTooShort, kTooShort, kTooShort, kTooShort, kTooShort,
+            kCont1000, kCont1001, kCont101, kCont101, kTooShort, kTooShort, kTooShort, kTooShort,
+            kTooShort, kTooShort, kTooShort, kTooShort, kTooShort, kTooShort, kTooShort, kTooShort,
+            kCont1000, kCont1001, kCont101, kCont101, kTooShort, kTooShort, kTooShort, kTooShort);
+
+        const __m256i nibble = _mm256_set1_epi8(0x0F);
+        __m256i input = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(bytes));
+        // The block starts on a boundary, so the bytes before it behave like ASCII
+        __m256i shifted_in = _mm256_permute2x128_si256(_mm256_setzero_si256(), input, 0x21);
+        __m256i prev1 = _mm256_alignr_epi8(input, shifted_in, 15);
+        __m256i prev2 = _mm256_alignr_epi8(input, shifted_in, 14);
+        __m256i prev3 = _mm256_alignr_epi8(input, shifted_in, 13);
+
+        __m256i byte1_high = _mm256_shuffle_epi8(byte1_high_table,
+                                                 _mm256_and_si256(_mm256_srli_epi16(prev1, 4), nibble));
+        __m256i byte1_low = _mm256_shuffle_epi8(byte1_low_table, _mm256_and_si256(prev1, nibble));
+        __m256i byte2_high = _mm256_shuffle_epi8(byte2_high_table,
+                                                 _mm256_and_si256(_mm256_srli_epi16(input, 4), nibble));
+        __m256i special = _mm256_and_si256(_mm256_and_si256(byte1_high, byte1_low), byte2_high);
+
+        // Third and fourth bytes of a sequence must be continuations
+        __m256i third = _mm256_subs_epu8(prev2, _mm256_set1_epi8(static_cast<char>(0xE0 - 0x80)));
+        __m256i fourth = _mm256_subs_epu8(prev3, _mm256_set1_epi8(static_cast<char>(0xF0 - 0x80)));
+        __m256i must_continue = _mm256_and_si256(_mm256_or_si256(third, fourth),
+                                                 _mm256_set1_epi8(static_cast<char>(0x80)));
+        __m256i error = _mm256_xor_si256(must_continue, special);
+        return _mm256_testz_si256(error, error) != 0;
+    }
+#endif
+
+    unsigned need_ = 0;        // Continuation bytes still expected
+    char32_t codepoint_ = 0;   // Bits collected so far
+    unsigned char lower_ = 0x80; // Range allowed for the next continuation byte
+    unsigned char upper_ = 0xBF;
+};
@@ -0,0 +1,424 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "simd_scan.h"
+
+// DEC VT500-series escape sequence parser.
+//
+// Implements the state machine described by Paul Williams
+// (https://vt100.net/emu/dec_ansi_parser) with the transition, entry and exit
+// tables generated at compile time. Each byte costs at most one table lookup:
+// printable runs, OSC/DCS string data and CSI parameters are scanned directly
+// and delivered to the handler in one call. The parser is fed from both
+// directions: keystrokes arriving on stdin and shell output headed for stdout.
+//
+// Deviations from the DEC machine, for a UTF-8 terminal:
+//  - bytes 0x80-0xFF are printed in the ground state and passed through in
+//    strings instead of being treated as C1 controls (they are UTF-8 units);
+//  - DEL (0x7F) in the ground state is executed rather than ignored, so
+//    keystroke input sees Backspace;
+//  - BEL terminates OSC strings, as in xterm;
+//  - ':' separates sub-parameters (e.g. SGR 38:2:r:g:b) instead of
+//    invalidating the sequence.
+
+enum class VtState : uint8_t {
+    kGround,
+    kEscape,
+    kEscapeIntermediate,
+    kCsiEntry,
+    kCsiParam,
+    kCsiIntermediate,
+    kCsiIgnore,
+    kDcsEntry,
+    kDcsParam,
+    kDcsIntermediate,
+    kDcsPassthrough,
+    kDcsIgnore,
+    kOscString,
+    kSosPmApcString,
+};
+
+// Parameters, intermediates and final byte of a dispatched sequence
+struct VtSequence {
+    static constexpr size_t kMaxParams = 16;
+    static constexpr size_t kMaxIntermediates = 4;
+
+    uint16_t params[kMaxParams];
+    uint16_t subparams = 0;      // Bit i set when params[i] followed a ':'
+    uint8_t param_count = 0;
+    char intermediates[kMaxIntermediates]; // Includes a leading private marker such as '?'
+    uint8_t intermediate_count = 0;
+    char final = 0;
+
+    // Parameter i, or def when it was omitted or zero (the DEC convention)
+    unsigned param(size_t i, unsigned def) const {
+        return i < param_count && params[i] != 0 ? params[i] : def;
+    }
+
+    bool hasIntermediates(const char* expected) const {
+        size_t length = std::char_traits<char>::length(expected);
+        return length == intermediate_count &&
+               std::char_traits<char>::compare(intermediates, expected, length) == 0;
+    }
+};
+
+// Callbacks the parser invokes; handlers derive from this and hide the ones
+// they care about. Dispatch is resolved at compile time, so unused callbacks
+// cost nothing.
+struct VtHandler {
+    void print(const char*, size_t) {}
+    void execute(unsigned char) {}
+    void escDispatch(const VtSequence&) {}
+    void csiDispatch(const VtSequence&) {}
+    void hook(const VtSequence&) {}
+    void put(const char*, size_t) {}
+    void unhook() {}
+    void oscDispatch(const char*, size_t) {}
+};
+
+namespace vt_detail {
+
+enum Action : uint8_t {
+    kNone,
+    kPrint,
+    kExecute,
+    kClear,
+    kCollect,
+    kParam,
+    kEscDispatch,
+    kCsiDispatch,
+    kHook,
+    kPut,
+    kUnhook,
+    kOscStart,
+    kOscPut,
+    kOscEnd,
+};
+
+constexpr size_t kStateCount = static_cast<size_t>(VtState::kSosPmApcString) + 1;
+
+// Each transition packs the action in the high nibble and the next state in the low one
+struct Tables {
+    uint8_t transitions[kStateCount][256];
+    uint8_t entry[kStateCount];
+    uint8_t exit[kStateCount];
+};
+
+constexpr uint8_t pack(Action action, VtState next) {
+    return static_cast<uint8_t>(action << 4 | static_cast<uint8_t>(next));
+}
+
+constexpr void fill(Tables& t, VtState state, unsigned first, unsigned last, Action action, VtState next) {
+    for (unsigned c = first; c <= last; ++c) {
+        t.transitions[static_cast<size_t>(state)][c] = pack(action, next);
+    }
+}
+
+// C0 controls other than CAN, SUB and ESC, which are handled from every state
+constexpr void fillC0(Tables& t, VtState state, Action action) {
+    fill(t, state, 0x00, 0x17, action, state);
+    fill(t, state, 0x19, 0x19, action, state);
+    fill(t, state, 0x1C, 0x1F, action, state);
+}
+
+constexpr Tables buildTables() {
+    Tables t{};
+    using S = VtState;
+
+    // Unlisted bytes are ignored without leaving the current state
+    for (size_t s = 0; s < kStateCount; ++s) {
+        fill(t, static_cast<S>(s), 0x00, 0xFF, kNone, static_cast<S>(s));
+    }
+
+    fillC0(t, S::kGround, kExecute);
+    fill(t, S::kGround, 0x20, 0x7E, kPrint, S::kGround);
+    fill(t, S::kGround, 0x7F, 0x7F, kExecute, S::kGround);
+    fill(t, S::kGround, 0x80, 0xFF, kPrint, S::kGround);
+
+    fillC0(t, S::kEscape, kExecute);
+    fill(t, S::kEscape, 0x20, 0x2F, kCollect, S::kEscapeIntermediate);
+    fill(t, S::kEscape, 0x30, 0x7E, kEscDispatch, S::kGround);
+    fill(t, S::kEscape, 'P', 'P', kNone, S::kDcsEntry);
+    fill(t, S::kEscape, 'X', 'X', kNone, S::kSosPmApcString);
+    fill(t, S::kEscape, '[', '[', kNone, S::kCsiEntry);
+    fill(t, S::kEscape, ']', ']', kNone, S::kOscString);
+    fill(t, S::kEscape, '^', '_', kNone, S::kSosPmApcString);
+
+    fillC0(t, S::kEscapeIntermediate, kExecute);
+    fill(t, S::kEscapeIntermediate, 0x20, 0x2F, kCollect, S::kEscapeIntermediate);
+    fill(t, S::kEscapeIntermediate, 0x30, 0x7E, kEscDispatch, S::kGround);
+
+    fillC0(t, S::kCsiEntry, kExecute);
+    fill(t, S::kCsiEntry, 0x20, 0x2F, kCollect, S::kCsiIntermediate);
+    fill(t, S::kCsiEntry, 0x30, 0x3B, kParam, S::kCsiParam);
+    fill(t, S::kCsiEntry, 0x3C, 0x3F, kCollect, S::kCsiParam);
+    fill(t, S::kCsiEntry, 0x40, 0x7E, kCsiDispatch, S::kGround);
+
+    fillC0(t, S::kCsiParam, kExecute);
+    fill(t, S::kCsiParam, 0x20, 0x2F, kCollect, S::kCsiIntermediate);
+    fill(t, S::kCsiParam, 0x30, 0x3B, kParam, S::kCsiParam);
+    fill(t, S::kCsiParam, 0x3C, 0x3F, kNone, S::kCsiIgnore);
+    fill(t, S::kCsiParam, 0x40, 0x7E, kCsiDispatch, S::kGround);
+
+    fillC0(t, S::kCsiIntermediate, kExecute);
+    fill(t, S::kCsiIntermediate, 0x20, 0x2F, kCollect, S::kCsiIntermediate);
+    fill(t, S::kCsiIntermediate, 0x30, 0x3F, kNone, S::kCsiIgnore);
+    fill(t, S::kCsiIntermediate, 0x40, 0x7E, kCsiDispatch, S::kGround);
+
+    fillC0(t, S::kCsiIgnore, kExecute);
+    fill(t, S::kCsiIgnore, 0x40, 0x7E, kNone, S::kGround);
+
+    fill(t, S::kDcsEntry, 0x20, 0x2F, kCollect, S::kDcsIntermediate);
+    fill(t, S::kDcsEntry, 0x30, 0x3B, kParam, S::kDcsParam);
+    fill(t, S::kDcsEntry, 0x3C, 0x3F, kCollect, S::kDcsParam);
+    fill(t, S::kDcsEntry, 0x40, 0x7E, kNone, S::kDcsPassthrough);
+
+    fill(t, S::kDcsParam, 0x20, 0x2F, kCollect, S::kDcsIntermediate);
+    fill(t, S::kDcsParam, 0x30, 0x3B, kParam, S::kDcsParam);
+    fill(t, S::kDcsParam, 0x3C, 0x3F, kNone, S::kDcsIgnore);
+    fill(t, S::kDcsParam, 0x40, 0x7E, kNone, S::kDcsPassthrough);
+
+    fill(t, S::kDcsIntermediate, 0x20, 0x2F, kCollect, S::kDcsIntermediate);
+    fill(t, S::kDcsIntermediate, 0x30, 0x3F, kNone, S::kDcsIgnore);
+    fill(t, S::kDcsIntermediate, 0x40, 0x7E, kNone, S::kDcsPassthrough);
+
+    fillC0(t, S::kDcsPassthrough, kPut);
+    fill(t, S::kDcsPassthrough, 0x20, 0x7E, kPut, S::kDcsPassthrough);
+    fill(t, S::kDcsPassthrough, 0x80, 0xFF, kPut, S::kDcsPassthrough);
+
+    fill(t, S::kOscString, 0x07, 0x07, kNone, S::kGround);
+    fill(t, S::kOscString, 0x20, 0x7F, kOscPut, S::kOscString);
+    fill(t, S::kOscString, 0x80, 0xFF, kOscPut, S::kOscString);
+
+    // CAN and SUB abort any sequence; ESC starts a new one (and terminates strings)
+    for (size_t s = 0; s < kStateCount; ++s) {
+        fill(t, static_cast<S>(s), 0x18, 0x18, kExecute, S::kGround);
+        fill(t, static_cast<S>(s), 0x1A, 0x1A, kExecute, S::kGround);
+        fill(t, static_cast<S>(s), 0x1B, 0x1B, kNone, S::kEscape);
+    }
+
+    t.entry[static_cast<size_t>(S::kEscape)] = kClear;
+    t.entry[static_cast<size_t>(S::kCsiEntry)] = kClear;
+    t.entry[static_cast<size_t>(S::kDcsEntry)] = kClear;
+    t.entry[static_cast<size_t>(S::kDcsPassthrough)] = kHook;
+    t.exit[static_cast<size_t>(S::kDcsPassthrough)] = kUnhook;
+    t.entry[static_cast<size_t>(S::kOscString)] = kOscStart;
+    t.exit[static_cast<size_t>(S::kOscString)] = kOscEnd;
+    return t;
+}
+
+inline constexpr Tables kTables = buildTables();
+
+} // namespace vt_detail
+
+class VtParser {
+public:
+    // OSC strings longer than this are truncated (titles and hyperlinks fit easily)
+    static constexpr size_t kMaxOscLength = 4096;
+
+    VtState state() const { return state_; }
+
+    void reset() {
+        state_ = VtState::kGround;
+        clear();
+        osc_.clear();
+    }
+
+    // Parses a chunk; sequences may be split across calls
+    template <typename Handler>
+    void feed(const char* data, size_t count, Handler& handler) {
+        const unsigned char* bytes = reinterpret_cast<const unsigned char*>(data);
+        size_t i = 0;
+        while (i < count) {
+            size_t run = stringRun(bytes + i, count - i);
+            if (run > 0) {
+                emitRun(data + i, run, handler);
+                i += run;
+                continue;
+            }
+            // CSI sequences dominate escape-heavy output; their introducer,
+            // parameters and final byte are taken without table lookups
+            if (state_ == VtState::kGround && bytes[i] == 0x1B && i + 1 < count && bytes[i + 1] == '[') {
+                clear();
+                state_ = VtState::kCsiEntry;
+                i += 2;
+                continue;
+            }
+            if (state_ == VtState::kCsiEntry || state_ == VtState::kCsiParam) {
+                run = paramRun(bytes + i, count - i);
+                if (run > 0) state_ = VtState::kCsiParam;
+                i += run;
+                if (i < count && bytes[i] >= 0x40 && bytes[i] <= 0x7E) {
+                    seq_.final = static_cast<char>(bytes[i++]);
+                    state_ = VtState::kGround;
+                    if (!overflow_) handler.csiDispatch(seq_);
+                    continue;
+                }
+                if (run > 0) continue;
+            }
+            advance(bytes[i++], handler);
+        }
+    }
+
+    // Parses a single byte
+    template <typename Handler>
+    void advance(unsigned char c, Handler& handler) {
+        uint8_t transition = vt_detail::kTables.transitions[static_cast<size_t>(state_)][c];
+        VtState next = static_cast<VtState>(transition & 0x0F);
+        if (next != state_) {
+            perform(vt_detail::kTables.exit[static_cast<size_t>(state_)], c, handler);
+            perform(static_cast<vt_detail::Action>(transition >> 4), c, handler);
+            state_ = next;
+            perform(vt_detail::kTables.entry[static_cast<size_t>(next)], c, handler);
+        } else {
+            perform(static_cast<vt_detail::Action>(transition >> 4), c, handler);
+        }
+    }
+
+private:
+    // Length of the leading run that stays in the current state with the
+    // same print/put action, so it can be delivered in one callback
+    size_t stringRun(const unsigned char* bytes, size_t count) const {
+        size_t i = 0;
+        switch (state_) {
+        case VtState::kGround:
+            return textRun(reinterpret_cast<const char*>(bytes), count);
+        case VtState::kOscString:
+            while (i < count && bytes[i] >= 0x20) ++i;
+            return i;
+        case VtState::kDcsPassthrough:
+            while (i < count && bytes[i] != 0x18 && bytes[i] != 0x1A &&
+                   bytes[i] != 0x1B && bytes[i] != 0x7F) ++i;
+            return i;
+        default:
+            return 0;
+        }
+    }
+
+    template <typename Handler>
+    void emitRun(const char* data, size_t count, Handler& handler) {
+        if (state_ == VtState::kGround) {
+            handler.print(data, count);
+        } else if (state_ == VtState::kDcsPassthrough) {
+            handler.put(data, count);
+        } else {
+            oscPut(data, count);
+        }
+    }
+
+    template <typename Handler>
+    void perform(uint8_t action, unsigned char c, Handler& handler) {
+        using namespace vt_detail;
+        switch (action) {
+        case kNone:
+            break;
+        case kPrint: {
+            char ch = static_cast<char>(c);
+            handler.print(&ch, 1);
+            break;
+        }
+        case kExecute:
+            handler.execute(c);
+            break;
+        case kClear:
+            clear();
+            break;
+        case kCollect:
+            if (seq_.intermediate_count < VtSequence::kMaxIntermediates) {
+                seq_.intermediates[seq_.intermediate_count++] = static_cast<char>(c);
+            } else {
+                overflow_ = true;
+            }
+            break;
+        case kParam:
+            param(c);
+            break;
+        case kEscDispatch:
+            seq_.final = static_cast<char>(c);
+            if (!overflow_) handler.escDispatch(seq_);
+            break;
+        case kCsiDispatch:
+            seq_.final = static_cast<char>(c);
+            if (!overflow_) handler.csiDispatch(seq_);
+            break;
+        case kHook:
+            seq_.final = static_cast<char>(c);
+            hooked_ = !overflow_;
+            if (hooked_) handler.hook(seq_);
+            break;
+        case kPut:
+            if (hooked_) {
+                char ch = static_cast<char>(c);
+                handler.put(&ch, 1);
+            }
+            break;
+        case kUnhook:
+            if (hooked_) handler.unhook();
+            hooked_ = false;
+            break;
+        case kOscStart:
+            osc_.clear();
+            break;
+        case kOscPut: {
+            char ch = static_cast<char>(c);
+            oscPut(&ch, 1);
+            break;
+        }
+        case kOscEnd:
+            handler.oscDispatch(osc_.data(), osc_.size());
+            osc_.clear();
+            break;
+        }
+    }
+
+    void clear() {
+        seq_.param_count = 0;
+        seq_.subparams = 0;
+        seq_.intermediate_count = 0;
+        seq_.final = 0;
+        overflow_ = false;
+        params_full_ = false;
+    }
+
+    // Consumes leading digits and separators into seq_, returning how many
+    size_t paramRun(const unsigned char* bytes, size_t count) {
+        size_t i = 0;
+        while (i < count && bytes[i] >= '0' && bytes[i] <= ';') param(bytes[i++]);
+        return i;
+    }
+
+    void param(unsigned char c) {
+        if (seq_.param_count == 0) {
+            seq_.params[0] = 0;
+            seq_.param_count = 1;
+        }
+        if (c == ';' || c == ':') {
+            if (seq_.param_count == VtSequence::kMaxParams) {
+                params_full_ = true; // Extra parameters, and their digits, are ignored
+                return;
+            }
+            if (c == ':') seq_.subparams |= static_cast<uint16_t>(1u << seq_.param_count);
+            seq_.params[seq_.param_count++] = 0;
+            return;
+        }
+        if (params_full_) return;
+        uint16_t& value = seq_.params[seq_.param_count - 1];
+        value = static_cast<uint16_t>(std::min(value * 10u + (c - '0'), 65535u));
+    }
+
+    void oscPut(const char* data, size_t count) {
+        size_t room = kMaxOscLength - osc_.size();
+        osc_.append(data, std::min(count, room));
+    }
+
+    VtState state_ = VtState::kGround;
+    VtSequence seq_;
+    bool overflow_ = false;    // Too many intermediates; the sequence is not dispatched
+    bool params_full_ = false; // kMaxParams reached; later parameters are dropped
+    bool hooked_ = false;      // A DCS hook was delivered and awaits unhook
+    std::string osc_;
+};